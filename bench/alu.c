@@ -0,0 +1,19 @@
+/* Tight ALU loop: addu/subu/and/or/xor/nor, shifts, slt/sltu and immediates. */
+#include "bench.h"
+
+int main(int argc, char** argv)
+{
+  unsigned int n = bench_iterations(argc, argv, 2000000);
+  unsigned int a = 0x12345678, b = 0x9abcdef0, c = 1;
+  int s = -7;
+
+  for (unsigned int i = 0; i < n; i++) {
+    a = a + (b ^ i);
+    b = (b - a) | (i << 3);
+    c = ~(a | c) + (b & 0xFF00);
+    s = (s >> 1) + (int) (c >> 5) - (int) i;
+    a ^= (unsigned int) (s < 0) + (a < b);
+    b = (b << (i & 7)) + 0x1234;
+  }
+  return bench_result("alu", a ^ b ^ c ^ (unsigned int) s);
+}
@@ -0,0 +1,36 @@
+/**
+ * @file      bench.h
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     Helpers shared by the guest benchmark kernels.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//! Iteration count: first argument, or the kernel default.
+static inline unsigned int bench_iterations(int argc, char** argv, unsigned int def)
+{
+  return argc > 1 ? (unsigned int) strtoul(argv[1], NULL, 0) : def;
+}
+
+//! Every kernel ends printing a checksum, so a faster simulator that
+//! computes something else does not go unnoticed.
+static inline int bench_result(const char* name, unsigned int checksum)
+{
+  printf("%s: checksum %08x\n", name, checksum);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,28 @@
+/* Branch-heavy code: data dependent, hard to predict branches. */
+#include "bench.h"
+
+int main(int argc, char** argv)
+{
+  unsigned int n = bench_iterations(argc, argv, 1000000);
+  unsigned int x = 1, hist[4] = { 0, 0, 0, 0 };
+
+  for (unsigned int i = 0; i < n; i++) {
+    x = x * 1103515245 + 12345;
+    if (x & 0x100) {
+      if ((int) x < 0)
+        hist[0]++;
+      else
+        hist[1] += 3;
+    }
+    else if ((x >> 20) > 0x700)
+      hist[2]--;
+    else
+      switch ((x >> 12) & 3) {
+      case 0: hist[3] += 1; break;
+      case 1: hist[3] ^= x; break;
+      case 2: hist[0] += hist[1]; break;
+      default: hist[1] -= 5; break;
+      }
+  }
+  return bench_result("branch", hist[0] ^ hist[1] ^ hist[2] ^ hist[3]);
+}
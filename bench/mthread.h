@@ -0,0 +1,119 @@
+/**
+ * @file      mthread.h
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     Guest side of the thread services of mips_thread.H.
+ *
+ * Needs a simulator built with -DGUEST_THREADS.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#ifndef MTHREAD_H
+#define MTHREAD_H
+
+/* Keep in sync with enum thread_sys in mips_thread.H */
+#define MTHREAD_CREATE  6000
+#define MTHREAD_JOIN    6001
+#define MTHREAD_EXIT    6002
+#define MTHREAD_YIELD   6003
+#define MTHREAD_SELF    6004
+#define MTHREAD_WAIT    6005
+#define MTHREAD_WAKE    6006
+#define MTHREAD_SET_TLS 6007
+#define MTHREAD_GET_TLS 6008
+#define MTHREAD_CORES   6009
+#define MTHREAD_CAS     6010
+
+typedef int mthread_t;
+typedef volatile unsigned int mthread_mutex_t;   /* 0 free, 1 locked, 2 contended */
+
+static inline unsigned int mthread_call(unsigned int code, unsigned int a0,
+                                        unsigned int a1, unsigned int a2)
+{
+  register unsigned int v0 __asm__("$2") = code;
+  register unsigned int r4 __asm__("$4") = a0;
+  register unsigned int r5 __asm__("$5") = a1;
+  register unsigned int r6 __asm__("$6") = a2;
+  __asm__ volatile ("syscall" : "+r" (v0) : "r" (r4), "r" (r5), "r" (r6) : "memory");
+  return v0;
+}
+
+/* Start entry(arg) on a stack of stack_size bytes (0 for the default). */
+static inline mthread_t mthread_create(void* (*entry)(void*), void* arg, unsigned int stack_size)
+{
+  return mthread_call(MTHREAD_CREATE, (unsigned int) entry, (unsigned int) arg, stack_size);
+}
+
+static inline void* mthread_join(mthread_t t)
+{
+  return (void*) mthread_call(MTHREAD_JOIN, t, 0, 0);
+}
+
+static inline void mthread_exit(void* value)
+{
+  mthread_call(MTHREAD_EXIT, (unsigned int) value, 0, 0);
+}
+
+static inline void mthread_yield(void)  { mthread_call(MTHREAD_YIELD, 0, 0, 0); }
+static inline mthread_t mthread_self(void) { return mthread_call(MTHREAD_SELF, 0, 0, 0); }
+static inline unsigned int mthread_cores(void) { return mthread_call(MTHREAD_CORES, 0, 0, 0); }
+
+static inline void mthread_set_tls(void* p) { mthread_call(MTHREAD_SET_TLS, (unsigned int) p, 0, 0); }
+static inline void* mthread_get_tls(void)   { return (void*) mthread_call(MTHREAD_GET_TLS, 0, 0, 0); }
+
+/* Sleep while *addr == expected. */
+static inline int mthread_wait(volatile unsigned int* addr, unsigned int expected)
+{
+  return mthread_call(MTHREAD_WAIT, (unsigned int) addr, expected, 0);
+}
+
+static inline int mthread_wake(volatile unsigned int* addr, unsigned int count)
+{
+  return mthread_call(MTHREAD_WAKE, (unsigned int) addr, count, 0);
+}
+
+static inline unsigned int mthread_cas(volatile unsigned int* addr, unsigned int expected,
+                                       unsigned int value)
+{
+  return mthread_call(MTHREAD_CAS, (unsigned int) addr, expected, value);
+}
+
+static inline unsigned int mthread_xchg(volatile unsigned int* addr, unsigned int value)
+{
+  unsigned int old;
+  do
+    old = *addr;
+  while (mthread_cas(addr, old, value) != old);
+  return old;
+}
+
+/* Futex mutex ("Futexes Are Tricky", mutex2). */
+static inline void mthread_mutex_lock(mthread_mutex_t* m)
+{
+  unsigned int c = mthread_cas(m, 0, 1);
+  if (c == 0)
+    return;
+  if (c != 2)
+    c = mthread_xchg(m, 2);
+  while (c != 0) {
+    mthread_wait(m, 2);
+    c = mthread_xchg(m, 2);
+  }
+}
+
+static inline void mthread_mutex_unlock(mthread_mutex_t* m)
+{
+  if (mthread_cas(m, 1, 0) != 1) {
+    *m = 0;
+    mthread_wake(m, 1);
+  }
+}
+
+#endif
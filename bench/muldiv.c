@@ -0,0 +1,19 @@
+/* mult/multu/div/divu with hi/lo traffic (mfhi/mflo). */
+#include "bench.h"
+
+int main(int argc, char** argv)
+{
+  unsigned int n = bench_iterations(argc, argv, 500000);
+  unsigned int acc = 0;
+  unsigned long long wide = 0;
+  int q = 0x7fff;
+
+  for (unsigned int i = 1; i <= n; i++) {
+    wide += (unsigned long long) (acc | 1) * (i + 0x10001);  /* multu, mfhi, mflo */
+    q = q * (int) (i & 0x3ff) - (int) (wide >> 33);           /* mult */
+    acc += (unsigned int) (wide >> 32) / i;                   /* divu */
+    acc ^= (unsigned int) (q / (int) ((i & 0xff) + 1));       /* div */
+    acc += (unsigned int) q % (i | 3);                        /* divu, mfhi */
+  }
+  return bench_result("muldiv", acc ^ (unsigned int) wide ^ (unsigned int) q);
+}
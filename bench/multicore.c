@@ -0,0 +1,60 @@
+/* Shared memory kernel: every core sums a slice of a shared array and
+ * core 0 combines the partial results. Run it on an MPSoC platform with
+ * NCORES cores (one copy per core); run_bench.sh only measures it there.
+ *
+ * MIPS-I has no atomic instructions, so the only synchronization is one
+ * single-writer flag per core. The begin behavior passes the core
+ * number in $k1 (see mips_memmap.H).
+ */
+#include "bench.h"
+
+#ifndef NCORES
+#define NCORES 1
+#endif
+#define SIZE (64 * 1024)
+
+static volatile unsigned int data[SIZE];
+static volatile unsigned int partial[NCORES], done[NCORES];
+static volatile unsigned int ready;
+
+static unsigned int core_id(void)
+{
+  unsigned int id;
+  __asm__ volatile ("move %0, $27" : "=r" (id));
+  return id;
+}
+
+int main(int argc, char** argv)
+{
+  unsigned int n = bench_iterations(argc, argv, 20);
+  unsigned int id = core_id();
+  unsigned int sum = 0;
+
+  if (id >= NCORES)
+    return 0;
+
+  if (id == 0) {
+    for (unsigned int i = 0; i < SIZE; i++)
+      data[i] = i * 2654435761u;
+    ready = 1;
+  }
+  while (!ready)
+    ;
+
+  for (unsigned int r = 0; r < n; r++) {
+    unsigned int s = 0;
+    for (unsigned int i = id; i < SIZE; i += NCORES)
+      s += data[i] >> (r & 7);
+    partial[id] += s;
+  }
+  done[id] = 1;
+
+  if (id != 0)
+    return 0;
+  for (unsigned int c = 0; c < NCORES; c++) {
+    while (!done[c])
+      ;
+    sum += partial[c];
+  }
+  return bench_result("multicore", sum);
+}
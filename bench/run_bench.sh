@@ -0,0 +1,119 @@
+#!/bin/sh
+#
+# Run the guest benchmark kernels and report simulator throughput.
+#
+#   run_bench.sh [-s simulator] [-m platform -n ncores] [-o results.csv]
+#                [-b baseline.csv] [-t threshold%] [kernel ...]
+#
+# Writes one CSV line per kernel:
+#   kernel,instructions,host_seconds,sim_mips,host_cycles_per_instr,peak_rss_kb,checksum
+#
+# The multicore kernel only runs on a multicore platform simulator (-m)
+# with the number of cores it was built for (-n, make NCORES=n), and
+# its instructions are the sum over all cores. Without both it is not
+# measured: a single core run would not exercise the shared memory.
+#
+# With -b, each kernel is compared with the baseline CSV (an earlier
+# results file). The script fails when simulated MIPS drops more than
+# the threshold (default 5%) or a checksum differs.
+#
+# Host cycles use $HOST_HZ, or the "cpu MHz" of /proc/cpuinfo.
+
+SIM=../mips.x
+MSIM=
+NCORES=1
+OUT=bench_results.csv
+BASELINE=
+THRESHOLD=5
+
+while getopts "s:m:n:o:b:t:" opt; do
+  case $opt in
+    s) SIM=$OPTARG ;;
+    m) MSIM=$OPTARG ;;
+    n) NCORES=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    b) BASELINE=$OPTARG ;;
+    t) THRESHOLD=$OPTARG ;;
+    *) sed -n '5,6s/^# *//p' "$0"; exit 2 ;;
+  esac
+done
+shift $((OPTIND - 1))
+KERNELS=${*:-"alu branch muldiv unaligned string syscall multicore"}
+
+if [ ! -x "$SIM" ]; then
+  echo "$SIM: simulator not found (use -s)" >&2
+  exit 2
+fi
+
+if [ -z "$HOST_HZ" ]; then
+  HOST_HZ=$(awk -F: '/^cpu MHz/ { printf "%d", $2 * 1000000; exit }' /proc/cpuinfo 2>/dev/null)
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+echo "kernel,instructions,host_seconds,sim_mips,host_cycles_per_instr,peak_rss_kb,checksum" > "$OUT"
+for k in $KERNELS; do
+  if [ ! -f "$k.mips" ]; then
+    echo "$k.mips: not built" >&2
+    exit 2
+  fi
+
+  sim=$SIM
+  if [ "$k" = multicore ]; then
+    if [ -z "$MSIM" ] || [ "$NCORES" -le 1 ]; then
+      echo "multicore: not measured (needs -m <platform> and -n <cores> > 1)" >&2
+      continue
+    fi
+    if [ ! -x "$MSIM" ]; then
+      echo "$MSIM: platform simulator not found" >&2
+      exit 2
+    fi
+    sim=$MSIM
+  fi
+
+  if [ -x /usr/bin/time ]; then
+    /usr/bin/time -f "%U %S %M" -o "$TMP/time" "$sim" --load="$k.mips" > "$k.out" 2> "$TMP/err"
+    read -r user sys rss < "$TMP/time"
+    secs=$(echo "$user $sys" | awk '{ print $1 + $2 }')
+  else
+    start=$(date +%s.%N)
+    "$sim" --load="$k.mips" > "$k.out" 2> "$TMP/err"
+    secs=$(echo "$start $(date +%s.%N)" | awk '{ print $2 - $1 }')
+    rss=NA
+  fi
+
+  # One count per core on a platform
+  instrs=$(sed -n 's/.*Number of instructions executed: *\([0-9]*\).*/\1/p' "$TMP/err" |
+           awk '{ n += $1 } END { if (NR) print n }')
+  checksum=$(sed -n 's/.*checksum \([0-9a-f]*\).*/\1/p' "$k.out")
+  if [ -z "$instrs" ] || [ -z "$checksum" ]; then
+    echo "$k: simulation failed, see $k.out" >&2
+    cat "$TMP/err" >&2
+    exit 1
+  fi
+
+  echo "$k $instrs $secs $rss $checksum ${HOST_HZ:-0}" | awk '{
+    s = ($3 > 0) ? $3 : 1e-6
+    cpi = ($6 > 0) ? sprintf("%.1f", s * $6 / $2) : "NA"
+    printf "%s,%d,%.3f,%.3f,%s,%s,%s\n", $1, $2, $3, $2 / s / 1e6, cpi, $4, $5
+  }' >> "$OUT"
+done
+
+cat "$OUT"
+
+[ -z "$BASELINE" ] && exit 0
+
+# kernel -> mips and checksum of the baseline, then check every result
+awk -F, -v t="$THRESHOLD" '
+  NR == FNR { if (FNR > 1) { mips[$1] = $4; sum[$1] = $7 } next }
+  FNR == 1 { next }
+  !($1 in mips) { printf "%-10s new kernel\n", $1; next }
+  {
+    change = (mips[$1] > 0) ? 100 * ($4 - mips[$1]) / mips[$1] : 0
+    status = "ok"
+    if ($7 != sum[$1]) { status = "CHECKSUM MISMATCH"; bad = 1 }
+    else if (change < -t) { status = "REGRESSION"; bad = 1 }
+    printf "%-10s %9.3f -> %9.3f MIPS (%+.1f%%) %s\n", $1, mips[$1], $4, change, status
+  }
+  END { exit bad }' "$BASELINE" "$OUT"
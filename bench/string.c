@@ -0,0 +1,36 @@
+/* Byte-wise string work: lb/lbu/sb loops (length, copy, reverse, search). */
+#include "bench.h"
+
+#define SIZE 2048
+
+static char text[SIZE], copy[SIZE];
+
+int main(int argc, char** argv)
+{
+  unsigned int n = bench_iterations(argc, argv, 200);
+  unsigned int sum = 0;
+
+  for (unsigned int i = 0; i < SIZE - 1; i++)
+    text[i] = 'a' + (i * 13) % 26;
+  text[SIZE - 1] = 0;
+
+  for (unsigned int r = 0; r < n; r++) {
+    volatile char* s = text;
+    char* d = copy;
+    unsigned int len = 0;
+
+    while (s[len])                         /* strlen */
+      len++;
+    for (unsigned int i = 0; i <= len; i++) /* strcpy */
+      d[i] = s[i];
+    for (unsigned int i = 0, j = len - 1; i < j; i++, j--) { /* reverse */
+      char t = d[i];
+      d[i] = d[j];
+      d[j] = t;
+    }
+    for (unsigned int i = 0; i < len; i++) /* count a character */
+      sum += d[i] == 'a' + (char) (r % 26);
+    text[r % (SIZE - 1)] = 'a' + (char) ((r * 5) % 26);
+  }
+  return bench_result("string", sum);
+}
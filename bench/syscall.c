@@ -0,0 +1,24 @@
+/* Syscall-heavy I/O: many small writes and reads through the emulation. */
+#include <fcntl.h>
+#include <unistd.h>
+#include "bench.h"
+
+int main(int argc, char** argv)
+{
+  unsigned int n = bench_iterations(argc, argv, 20000);
+  unsigned int sum = 0;
+  char c = 'x', buf[16];
+
+  int out = open("/dev/null", O_WRONLY);
+  int in = open("/dev/zero", O_RDONLY);
+  if (out < 0 || in < 0)
+    return 1;
+
+  for (unsigned int i = 0; i < n; i++) {
+    sum += write(out, &c, 1);
+    sum += read(in, buf, (i & 15) + 1);
+  }
+  close(in);
+  close(out);
+  return bench_result("syscall", sum);
+}
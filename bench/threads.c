@@ -0,0 +1,50 @@
+/* Guest threads: NTHREADS workers (default one per core) sum slices of a
+ * shared array and add their partial sums under a mutex. Needs a
+ * simulator built with -DGUEST_THREADS; compare runs on platforms with
+ * different core counts to see how it scales.
+ */
+#include "bench.h"
+#include "mthread.h"
+
+#define SIZE (64 * 1024)
+#define MAX_THREADS 64
+
+static unsigned int data[SIZE];
+static unsigned int rounds, nthreads;
+static unsigned int total;
+static mthread_mutex_t lock;
+
+static void* worker(void* arg)
+{
+  unsigned int id = (unsigned int) arg;
+  unsigned int s = 0;
+
+  for (unsigned int r = 0; r < rounds; r++)
+    for (unsigned int i = id; i < SIZE; i += nthreads)
+      s += data[i] >> (r & 7);
+
+  mthread_mutex_lock(&lock);
+  total += s;
+  mthread_mutex_unlock(&lock);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  mthread_t t[MAX_THREADS];
+
+  rounds = bench_iterations(argc, argv, 20);
+  nthreads = argc > 2 ? (unsigned int) atoi(argv[2]) : mthread_cores();
+  if (nthreads == 0 || nthreads > MAX_THREADS)
+    nthreads = 1;
+
+  for (unsigned int i = 0; i < SIZE; i++)
+    data[i] = i * 2654435761u;
+
+  for (unsigned int i = 0; i < nthreads; i++)
+    t[i] = mthread_create(worker, (void*) i, 0);
+  for (unsigned int i = 0; i < nthreads; i++)
+    mthread_join(t[i]);
+
+  return bench_result("threads", total);
+}
@@ -0,0 +1,30 @@
+/* Unaligned word copies: packed accesses compile to lwl/lwr/swl/swr. */
+#include "bench.h"
+
+#define SIZE 4096
+
+struct __attribute__((packed)) uword {
+  unsigned int v;
+};
+
+static unsigned char src[SIZE + 8], dst[SIZE + 8];
+
+int main(int argc, char** argv)
+{
+  unsigned int n = bench_iterations(argc, argv, 200);
+  unsigned int sum = 0;
+
+  for (unsigned int i = 0; i < sizeof(src); i++)
+    src[i] = (unsigned char) (i * 7 + 3);
+
+  for (unsigned int r = 0; r < n; r++) {
+    unsigned int so = 1 + (r & 2), doff = 3 - (r & 1);
+    for (unsigned int i = 0; i + 4 <= SIZE; i += 4) {
+      struct uword* s = (struct uword*) (src + so + i);
+      struct uword* d = (struct uword*) (dst + doff + i);
+      d->v = s->v + r;
+    }
+    sum += ((struct uword*) (dst + doff + (r * 4) % SIZE))->v;
+  }
+  return bench_result("unaligned", sum);
+}
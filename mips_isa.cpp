@@ -29,6 +29,58 @@
 //#define DEBUG_MODEL
 #include "ac_debug_model.H"
 
+//If you want to load program images given in $MIPS_IMAGE, see mips_image.H
+//#define PROGRAM_IMAGE
+#ifdef PROGRAM_IMAGE
+#include "mips_image.H"
+#endif
+
+//Stack, arguments and scratchpad of each core, see mips_memmap.H
+#include "mips_memmap.H"
+
+//If you want a soft-error injection campaign, see mips_fault.H
+//#define FAULT_CAMPAIGN
+#include "mips_fault.H"
+
+//If you want live statistics in shared memory, see mips_stats.H
+//#define LIVE_STATS
+#ifdef LIVE_STATS
+#include "mips_stats.H"
+#define STATS_RETIRE(id) \
+  mips_stats_shm::retire(mips_stats_shm::instance().slot_for(&RB), id, ac_instr_counter)
+#else
+#define STATS_RETIRE(id)
+#endif
+
+//If you want guest threads spread over the cores, see mips_thread.H
+//(mips_syscall.cpp needs it too for the shared heap: use -DGUEST_THREADS)
+//#define GUEST_THREADS
+#include "mips_thread.H"
+
+//If you want common instruction sequences fused, see mips_fusion.H
+//#define FUSE_IDIOMS
+#include "mips_fusion.H"
+#ifdef FUSE_IDIOMS
+#define FUSE_LEARN(id, imm) fusion_core->learn(id, rs, rt, imm)
+#define FUSE_STORE(addr) fusion_core->store(addr)
+#else
+#define FUSE_LEARN(id, imm)
+#define FUSE_STORE(addr)
+#endif
+
+//If you want traces for differential co-simulation, see mips_trace.H
+//#define DIFF_TRACE
+#ifdef DIFF_TRACE
+#include "mips_trace.H"
+// Trace of the core running the current instruction
+static mips_trace* trace_core;
+#define TRACE_WRITE(addr, size, value) trace_core->write(addr, size, value)
+#define TRACE_SYSCALL() trace_core->cut_block()
+#else
+#define TRACE_WRITE(addr, size, value)
+#define TRACE_SYSCALL()
+#endif
+
 
 //!User defined macros to reference registers.
 #define Ra 31
@@ -39,13 +91,68 @@
 using namespace mips_parms;
 
 static int processors_started = 0;
-#define DEFAULT_STACK_SIZE (256*1024)
+
+#ifdef PROGRAM_IMAGE
+static uint32_t image_entry, image_end;
+#endif
+
+#ifdef FAULT_CAMPAIGN
+static fault_campaign fault_injector;
+#endif
+
+#ifdef GUEST_THREADS
+static guest_threads threads;
+#endif
+
+#ifdef FUSE_IDIOMS
+static mips_fusion_stats fusion_stats;
+static mips_fusion_cores fusion_cores;
+// Learned instructions of the core running the current instruction
+static mips_fusion_core* fusion_core;
+static int processors_ended = 0;
+#endif
 
 //!Generic instruction behavior method.
 void ac_behavior( instruction )
 { 
    dbg_printf("----- PC=%#x ----- %lld\n", (int) ac_pc, ac_instr_counter);
   //  dbg_printf("----- PC=%#x NPC=%#x ----- %lld\n", (int) ac_pc, (int)npc, ac_instr_counter);
+#ifdef FAULT_CAMPAIGN
+  // Every fault planned at this instruction forks its own child
+  while (ac_instr_counter >= fault_injector.next_point()) {
+    // Only the forked child gets a fault to apply
+    const fault_campaign::fault* f = fault_injector.reach_point();
+    if (f) {
+      switch (f->target) {
+      case fault_campaign::FAULT_RB:
+        RB[f->index] = RB[f->index] ^ (1u << f->bit);
+        break;
+      case fault_campaign::FAULT_HI:
+        hi = hi ^ (1u << f->bit);
+        break;
+      case fault_campaign::FAULT_LO:
+        lo = lo ^ (1u << f->bit);
+        break;
+      case fault_campaign::FAULT_DM:
+        DATA_PORT->write_byte(f->index, DATA_PORT->read_byte(f->index) ^ (1u << f->bit));
+        break;
+      }
+    }
+  }
+#endif
+#ifdef DIFF_TRACE
+  trace_core = &mips_trace_set::instance().for_core(&RB);
+  if (trace_core->at(ac_instr_counter, ac_pc)) {
+    uint32_t regs[32];
+    for (int i = 0; i < 32; i++)
+      regs[i] = RB[i];
+    trace_core->state(regs, hi, lo, DATA_PORT->read(ac_pc));
+  }
+#endif
+#ifdef FUSE_IDIOMS
+  fusion_core = &fusion_cores.for_core(&RB);
+  fusion_core->pc = ac_pc;
+#endif
 #ifndef NO_NEED_PC_UPDATE
   ac_pc = npc;
   npc = ac_pc + 4;
@@ -70,19 +177,101 @@ void ac_behavior(begin)
   hi = 0;
   lo = 0;
 
-  RB[29] =  AC_RAM_END - 1024 - processors_started++ * DEFAULT_STACK_SIZE;
+  mips_memmap& memmap = mips_memmap::instance(AC_RAM_END);
+
+#ifdef PROGRAM_IMAGE
+  // A program image replaces what --load placed in memory
+  const char* image_file = getenv("MIPS_IMAGE");
+  if (image_file) {
+    // Memory is shared: the first core checks and copies the image, the
+    // others only take its entry point
+    if (processors_started == 0) {
+      mips_image image;
+      if (!image.open(image_file, AC_RAM_END))
+        exit(EXIT_FAILURE);
+      mips_image_copy(image, DATA_PORT);
+      image_entry = image.entry;
+      image_end = image.end();
+    }
+    // brk hands out memory from the end of the highest segment
+    ac_heap_ptr = (image_end + 7) & ~7U;
+    ac_pc = image_entry;
+    npc = ac_pc + 4;
+  }
+#endif
+
+  // brk starts past the program, from the image or ArchC's loader
+  memmap.set_heap_end(ac_heap_ptr);
+  unsigned int core = processors_started++;
+  memmap.check(core);
+#ifdef LIVE_STATS
+  // Statistics slots follow the core order
+  mips_stats_shm::instance().slot_for(&RB);
+#endif
+  RB[29] = memmap.stack_top(core);
+  RB[26] = memmap.scratch_base(core);
+  RB[27] = core;
+
+#ifdef GUEST_THREADS
+  threads.add_core(&RB, memmap.block_bottom(core), RB[26], RB[27]);
+  // Blocks are laid out downwards, so the arena starts under this one
+  memmap.check_below(core, THREAD_ARENA_SIZE, "thread stack arena");
+  if (core == 0)
+    // Idle loop and thread exit path
+    threads.install_stub(DATA_PORT, memmap.reserved(0));
+  else {
+    // Only the first core runs the program, the others wait for threads
+    thread_context ctx;
+    threads.park(ctx);
+    RB[2] = ctx.regs[2];
+    ac_pc = ctx.pc;
+    npc = ac_pc + 4;
+  }
+#endif
+
+#ifdef DIFF_TRACE
+  mips_trace_set::instance().open(&RB, core);
+#endif
+
+#ifdef FAULT_CAMPAIGN
+  fault_injector.init();
+#endif
 }
 
 //!Behavior called after finishing simulation
 void ac_behavior(end)
 {
   dbg_printf("@@@ end behavior @@@\n");
+
+#ifdef GUEST_THREADS
+  threads.end(&RB);
+#endif
+
+#ifdef DIFF_TRACE
+  uint32_t regs[32];
+  for (int i = 0; i < 32; i++)
+    regs[i] = RB[i];
+  mips_trace_set::instance().for_core(&RB).finish(ac_pc, regs, hi, lo);
+#endif
+
+#ifdef FAULT_CAMPAIGN
+  // The exit system call leaves the guest exit status in $a0
+  fault_injector.finish(RB[4]);
+#endif
+
+#ifdef FUSE_IDIOMS
+  // Counts are shared, print them once for all cores
+  fusion_stats.instructions += ac_instr_counter;
+  if (++processors_ended == processors_started)
+    fusion_stats.print(stderr);
+#endif
 }
 
 
 //!Instruction lb behavior method.
 void ac_behavior( lb )
 {
+  STATS_RETIRE(MIPS_LB);
   char byte;
   dbg_printf("lb r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   byte = DATA_PORT->read_byte(RB[rs]+ imm);
@@ -93,6 +282,7 @@ void ac_behavior( lb )
 //!Instruction lbu behavior method.
 void ac_behavior( lbu )
 {
+  STATS_RETIRE(MIPS_LBU);
   unsigned char byte;
   dbg_printf("lbu r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   byte = DATA_PORT->read_byte(RB[rs]+ imm);
@@ -103,6 +293,7 @@ void ac_behavior( lbu )
 //!Instruction lh behavior method.
 void ac_behavior( lh )
 {
+  STATS_RETIRE(MIPS_LH);
   short int half;
   dbg_printf("lh r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   half = DATA_PORT->read_half(RB[rs]+ imm);
@@ -113,6 +304,7 @@ void ac_behavior( lh )
 //!Instruction lhu behavior method.
 void ac_behavior( lhu )
 {
+  STATS_RETIRE(MIPS_LHU);
   unsigned short int  half;
   half = DATA_PORT->read_half(RB[rs]+ imm);
   RB[rt] = half ;
@@ -122,14 +314,35 @@ void ac_behavior( lhu )
 //!Instruction lw behavior method.
 void ac_behavior( lw )
 {
+  STATS_RETIRE(MIPS_LW);
+  FUSE_LEARN(MIPS_LW, imm);
   dbg_printf("lw r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   RB[rt] = DATA_PORT->read(RB[rs]+ imm);
   dbg_printf("Result = %#x\n", RB[rt]);
+#ifdef FUSE_IDIOMS
+  // Epilogue: lw $ra, off($sp); jr $ra; addiu $sp, $sp, size
+  if (rt == Ra && rs == Sp) {
+    const mips_fusion_entry* next = fusion_core->lookup(ac_pc);
+    if (next && next->handler == FUSE_JR && next->rs == Ra) {
+      FUSE_RETIRE(MIPS_JR);
+      npc = RB[Ra];
+      next = fusion_core->lookup(ac_pc);
+      if (next && next->handler == FUSE_ADDIU && next->rs == Sp && next->rt == Sp) {
+        RB[Sp] = RB[Sp] + next->imm;
+        FUSE_RETIRE(MIPS_ADDIU);
+        fusion_stats.count[FUSE_EPILOGUE_JR_ADDIU]++;
+      }
+      else
+        fusion_stats.count[FUSE_EPILOGUE_JR]++;
+    }
+  }
+#endif
 };
 
 //!Instruction lwl behavior method.
 void ac_behavior( lwl )
 {
+  STATS_RETIRE(MIPS_LWL);
   dbg_printf("lwl r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   unsigned int addr, offset;
   ac_Uword data;
@@ -146,6 +359,7 @@ void ac_behavior( lwl )
 //!Instruction lwr behavior method.
 void ac_behavior( lwr )
 {
+  STATS_RETIRE(MIPS_LWR);
   dbg_printf("lwr r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   unsigned int addr, offset;
   ac_Uword data;
@@ -162,34 +376,45 @@ void ac_behavior( lwr )
 //!Instruction sb behavior method.
 void ac_behavior( sb )
 {
+  STATS_RETIRE(MIPS_SB);
   unsigned char byte;
   dbg_printf("sb r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   byte = RB[rt] & 0xFF;
   DATA_PORT->write_byte(RB[rs] + imm, byte);
+  TRACE_WRITE(RB[rs] + imm, 1, byte);
+  FUSE_STORE(RB[rs] + imm);
   dbg_printf("Result = %#x\n", (int) byte);
 };
 
 //!Instruction sh behavior method.
 void ac_behavior( sh )
 {
+  STATS_RETIRE(MIPS_SH);
   unsigned short int half;
   dbg_printf("sh r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   half = RB[rt] & 0xFFFF;
   DATA_PORT->write_half(RB[rs] + imm, half);
+  TRACE_WRITE(RB[rs] + imm, 2, half);
+  FUSE_STORE(RB[rs] + imm);
   dbg_printf("Result = %#x\n", (int) half);
 };
 
 //!Instruction sw behavior method.
 void ac_behavior( sw )
 {
+  STATS_RETIRE(MIPS_SW);
+  FUSE_LEARN(MIPS_SW, imm);
   dbg_printf("sw r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   DATA_PORT->write(RB[rs] + imm, RB[rt]);
+  TRACE_WRITE(RB[rs] + imm, 4, RB[rt]);
+  FUSE_STORE(RB[rs] + imm);
   dbg_printf("Result = %#x\n", RB[rt]);
 };
 
 //!Instruction swl behavior method.
 void ac_behavior( swl )
 {
+  STATS_RETIRE(MIPS_SWL);
   dbg_printf("swl r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   unsigned int addr, offset;
   ac_Uword data;
@@ -200,12 +425,15 @@ void ac_behavior( swl )
   data >>= offset;
   data |= DATA_PORT->read(addr & 0xFFFFFFFC) & (0xFFFFFFFF << (32-offset));
   DATA_PORT->write(addr & 0xFFFFFFFC, data);
+  TRACE_WRITE(addr & 0xFFFFFFFC, 4, data);
+  FUSE_STORE(addr);
   dbg_printf("Result = %#x\n", data);
 };
 
 //!Instruction swr behavior method.
 void ac_behavior( swr )
 {
+  STATS_RETIRE(MIPS_SWR);
   dbg_printf("swr r%d, %d(r%d)\n", rt, imm & 0xFFFF, rs);
   unsigned int addr, offset;
   ac_Uword data;
@@ -216,12 +444,15 @@ void ac_behavior( swr )
   data <<= offset;
   data |= DATA_PORT->read(addr & 0xFFFFFFFC) & ((1<<offset)-1);
   DATA_PORT->write(addr & 0xFFFFFFFC, data);
+  TRACE_WRITE(addr & 0xFFFFFFFC, 4, data);
+  FUSE_STORE(addr);
   dbg_printf("Result = %#x\n", data);
 };
 
 //!Instruction addi behavior method.
 void ac_behavior( addi )
 {
+  STATS_RETIRE(MIPS_ADDI);
   dbg_printf("addi r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   RB[rt] = RB[rs] + imm;
   dbg_printf("Result = %#x\n", RB[rt]);
@@ -235,14 +466,41 @@ void ac_behavior( addi )
 //!Instruction addiu behavior method.
 void ac_behavior( addiu )
 {
+  STATS_RETIRE(MIPS_ADDIU);
+  FUSE_LEARN(MIPS_ADDIU, imm);
   dbg_printf("addiu r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   RB[rt] = RB[rs] + imm;
   dbg_printf("Result = %#x\n", RB[rt]);
+#ifdef FUSE_IDIOMS
+  // Prologue: addiu $sp, $sp, -size; sw rX, off($sp) [; sw rY, off($sp)]
+  if (rt == Sp && rs == Sp && imm < 0) {
+    int stores = 0;
+    for (; stores < 2; stores++) {
+      const mips_fusion_entry* next = fusion_core->lookup(ac_pc);
+      if (!next || next->rs != Sp)
+        break;
+      bool stored = true;
+      switch (next->handler) {
+      case FUSE_SW:           FUSE_SW_AT(RB[Sp], false, false); break;
+      case FUSE_SW_IMM0:      FUSE_SW_AT(RB[Sp], true, false); break;
+      case FUSE_SW_ZERO:      FUSE_SW_AT(RB[Sp], false, true); break;
+      case FUSE_SW_ZERO_IMM0: FUSE_SW_AT(RB[Sp], true, true); break;
+      default:                stored = false;
+      }
+      if (!stored)
+        break;
+      FUSE_RETIRE(MIPS_SW);
+    }
+    if (stores)
+      fusion_stats.count[stores == 1 ? FUSE_PROLOGUE_SW : FUSE_PROLOGUE_SW_SW]++;
+  }
+#endif
 };
 
 //!Instruction slti behavior method.
 void ac_behavior( slti )
 {
+  STATS_RETIRE(MIPS_SLTI);
   dbg_printf("slti r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   // Set the RD if RS< IMM
   if( (ac_Sword) RB[rs] < (ac_Sword) imm )
@@ -256,6 +514,7 @@ void ac_behavior( slti )
 //!Instruction sltiu behavior method.
 void ac_behavior( sltiu )
 {
+  STATS_RETIRE(MIPS_SLTIU);
   dbg_printf("sltiu r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   // Set the RD if RS< IMM
   if( (ac_Uword) RB[rs] < (ac_Uword) imm )
@@ -269,6 +528,7 @@ void ac_behavior( sltiu )
 //!Instruction andi behavior method.
 void ac_behavior( andi )
 {	
+  STATS_RETIRE(MIPS_ANDI);
   dbg_printf("andi r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   RB[rt] = RB[rs] & (imm & 0xFFFF) ;
   dbg_printf("Result = %#x\n", RB[rt]);
@@ -277,6 +537,8 @@ void ac_behavior( andi )
 //!Instruction ori behavior method.
 void ac_behavior( ori )
 {	
+  STATS_RETIRE(MIPS_ORI);
+  FUSE_LEARN(MIPS_ORI, imm);
   dbg_printf("ori r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   RB[rt] = RB[rs] | (imm & 0xFFFF) ;
   dbg_printf("Result = %#x\n", RB[rt]);
@@ -285,6 +547,7 @@ void ac_behavior( ori )
 //!Instruction xori behavior method.
 void ac_behavior( xori )
 {	
+  STATS_RETIRE(MIPS_XORI);
   dbg_printf("xori r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   RB[rt] = RB[rs] ^ (imm & 0xFFFF) ;
   dbg_printf("Result = %#x\n", RB[rt]);
@@ -293,17 +556,49 @@ void ac_behavior( xori )
 //!Instruction lui behavior method.
 void ac_behavior( lui )
 {	
+  STATS_RETIRE(MIPS_LUI);
   dbg_printf("lui r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   // Load a constant in the upper 16 bits of a register
   // To achieve the desired behaviour, the constant was shifted 16 bits left
   // and moved to the target register ( rt )
   RB[rt] = imm << 16;
   dbg_printf("Result = %#x\n", RB[rt]);
+#ifdef FUSE_IDIOMS
+  // The upper half is only ever completed through rt
+  const mips_fusion_entry* next = fusion_core->lookup(ac_pc);
+  if (next && next->rs == rt) {
+    ac_Uword upper = RB[rt];
+    int kind;
+    switch (next->handler) {
+    case FUSE_ORI:          RB[next->rt] = mips_fuse_ori<false>(upper, next->imm);
+                            kind = FUSE_LUI_ORI; break;
+    case FUSE_ORI_IMM0:     RB[next->rt] = mips_fuse_ori<true>(upper, next->imm);
+                            kind = FUSE_LUI_ORI; break;
+    case FUSE_ADDIU:        RB[next->rt] = mips_fuse_add<false>(upper, next->imm);
+                            kind = FUSE_LUI_ADDIU; break;
+    case FUSE_ADDIU_IMM0:   RB[next->rt] = mips_fuse_add<true>(upper, next->imm);
+                            kind = FUSE_LUI_ADDIU; break;
+    case FUSE_LW:           RB[next->rt] = DATA_PORT->read(mips_fuse_add<false>(upper, next->imm));
+                            kind = FUSE_LUI_LW; break;
+    case FUSE_LW_IMM0:      RB[next->rt] = DATA_PORT->read(mips_fuse_add<true>(upper, next->imm));
+                            kind = FUSE_LUI_LW; break;
+    case FUSE_SW:           FUSE_SW_AT(upper, false, false); kind = FUSE_LUI_SW; break;
+    case FUSE_SW_IMM0:      FUSE_SW_AT(upper, true, false); kind = FUSE_LUI_SW; break;
+    case FUSE_SW_ZERO:      FUSE_SW_AT(upper, false, true); kind = FUSE_LUI_SW; break;
+    case FUSE_SW_ZERO_IMM0: FUSE_SW_AT(upper, true, true); kind = FUSE_LUI_SW; break;
+    default:
+      return;
+    }
+    fusion_stats.count[kind]++;
+    FUSE_RETIRE(next->id);
+  }
+#endif
 };
 
 //!Instruction add behavior method.
 void ac_behavior( add )
 {
+  STATS_RETIRE(MIPS_ADD);
   dbg_printf("add r%d, r%d, r%d\n", rd, rs, rt);
   RB[rd] = RB[rs] + RB[rt];
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -317,6 +612,7 @@ void ac_behavior( add )
 //!Instruction addu behavior method.
 void ac_behavior( addu )
 {
+  STATS_RETIRE(MIPS_ADDU);
   dbg_printf("addu r%d, r%d, r%d\n", rd, rs, rt);
   RB[rd] = RB[rs] + RB[rt];
   //cout << "  RS: " << (unsigned int)RB[rs] << " RT: " << (unsigned int)RB[rt] << endl;
@@ -327,6 +623,7 @@ void ac_behavior( addu )
 //!Instruction sub behavior method.
 void ac_behavior( sub )
 {
+  STATS_RETIRE(MIPS_SUB);
   dbg_printf("sub r%d, r%d, r%d\n", rd, rs, rt);
   RB[rd] = RB[rs] - RB[rt];
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -336,6 +633,7 @@ void ac_behavior( sub )
 //!Instruction subu behavior method.
 void ac_behavior( subu )
 {
+  STATS_RETIRE(MIPS_SUBU);
   dbg_printf("subu r%d, r%d, r%d\n", rd, rs, rt);
   RB[rd] = RB[rs] - RB[rt];
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -344,6 +642,7 @@ void ac_behavior( subu )
 //!Instruction slt behavior method.
 void ac_behavior( slt )
 {	
+  STATS_RETIRE(MIPS_SLT);
   dbg_printf("slt r%d, r%d, r%d\n", rd, rs, rt);
   // Set the RD if RS< RT
   if( (ac_Sword) RB[rs] < (ac_Sword) RB[rt] )
@@ -352,11 +651,15 @@ void ac_behavior( slt )
   else
     RB[rd] = 0;
   dbg_printf("Result = %#x\n", RB[rd]);
+#ifdef FUSE_IDIOMS
+  FUSE_SET_BRANCH(rd, FUSE_SLT_BRANCH);
+#endif
 };
 
 //!Instruction sltu behavior method.
 void ac_behavior( sltu )
 {
+  STATS_RETIRE(MIPS_SLTU);
   dbg_printf("sltu r%d, r%d, r%d\n", rd, rs, rt);
   // Set the RD if RS < RT
   if( RB[rs] < RB[rt] )
@@ -365,11 +668,15 @@ void ac_behavior( sltu )
   else
     RB[rd] = 0;
   dbg_printf("Result = %#x\n", RB[rd]);
+#ifdef FUSE_IDIOMS
+  FUSE_SET_BRANCH(rd, FUSE_SLTU_BRANCH);
+#endif
 };
 
 //!Instruction instr_and behavior method.
 void ac_behavior( instr_and )
 {
+  STATS_RETIRE(MIPS_AND);
   dbg_printf("instr_and r%d, r%d, r%d\n", rd, rs, rt);
   RB[rd] = RB[rs] & RB[rt];
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -378,6 +685,7 @@ void ac_behavior( instr_and )
 //!Instruction instr_or behavior method.
 void ac_behavior( instr_or )
 {
+  STATS_RETIRE(MIPS_OR);
   dbg_printf("instr_or r%d, r%d, r%d\n", rd, rs, rt);
   RB[rd] = RB[rs] | RB[rt];
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -386,6 +694,7 @@ void ac_behavior( instr_or )
 //!Instruction instr_xor behavior method.
 void ac_behavior( instr_xor )
 {
+  STATS_RETIRE(MIPS_XOR);
   dbg_printf("instr_xor r%d, r%d, r%d\n", rd, rs, rt);
   RB[rd] = RB[rs] ^ RB[rt];
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -394,6 +703,7 @@ void ac_behavior( instr_xor )
 //!Instruction instr_nor behavior method.
 void ac_behavior( instr_nor )
 {
+  STATS_RETIRE(MIPS_NOR);
   dbg_printf("nor r%d, r%d, r%d\n", rd, rs, rt);
   RB[rd] = ~(RB[rs] | RB[rt]);
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -402,12 +712,14 @@ void ac_behavior( instr_nor )
 //!Instruction nop behavior method.
 void ac_behavior( nop )
 {  
+  STATS_RETIRE(MIPS_NOP);
   dbg_printf("nop\n");
 };
 
 //!Instruction sll behavior method.
 void ac_behavior( sll )
 {  
+  STATS_RETIRE(MIPS_SLL);
   dbg_printf("sll r%d, r%d, %d\n", rd, rs, shamt);
   RB[rd] = RB[rt] << shamt;
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -416,6 +728,7 @@ void ac_behavior( sll )
 //!Instruction srl behavior method.
 void ac_behavior( srl )
 {
+  STATS_RETIRE(MIPS_SRL);
   dbg_printf("srl r%d, r%d, %d\n", rd, rs, shamt);
   RB[rd] = RB[rt] >> shamt;
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -424,6 +737,7 @@ void ac_behavior( srl )
 //!Instruction sra behavior method.
 void ac_behavior( sra )
 {
+  STATS_RETIRE(MIPS_SRA);
   dbg_printf("sra r%d, r%d, %d\n", rd, rs, shamt);
   RB[rd] = (ac_Sword) RB[rt] >> shamt;
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -432,6 +746,7 @@ void ac_behavior( sra )
 //!Instruction sllv behavior method.
 void ac_behavior( sllv )
 {
+  STATS_RETIRE(MIPS_SLLV);
   dbg_printf("sllv r%d, r%d, r%d\n", rd, rt, rs);
   RB[rd] = RB[rt] << (RB[rs] & 0x1F);
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -440,6 +755,7 @@ void ac_behavior( sllv )
 //!Instruction srlv behavior method.
 void ac_behavior( srlv )
 {
+  STATS_RETIRE(MIPS_SRLV);
   dbg_printf("srlv r%d, r%d, r%d\n", rd, rt, rs);
   RB[rd] = RB[rt] >> (RB[rs] & 0x1F);
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -448,6 +764,7 @@ void ac_behavior( srlv )
 //!Instruction srav behavior method.
 void ac_behavior( srav )
 {
+  STATS_RETIRE(MIPS_SRAV);
   dbg_printf("srav r%d, r%d, r%d\n", rd, rt, rs);
   RB[rd] = (ac_Sword) RB[rt] >> (RB[rs] & 0x1F);
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -456,6 +773,7 @@ void ac_behavior( srav )
 //!Instruction mult behavior method.
 void ac_behavior( mult )
 {
+  STATS_RETIRE(MIPS_MULT);
   dbg_printf("mult r%d, r%d\n", rs, rt);
 
   long long result;
@@ -478,6 +796,7 @@ void ac_behavior( mult )
 //!Instruction multu behavior method.
 void ac_behavior( multu )
 {
+  STATS_RETIRE(MIPS_MULTU);
   dbg_printf("multu r%d, r%d\n", rs, rt);
 
   unsigned long long result;
@@ -500,6 +819,7 @@ void ac_behavior( multu )
 //!Instruction div behavior method.
 void ac_behavior( div )
 {
+  STATS_RETIRE(MIPS_DIV);
   dbg_printf("div r%d, r%d\n", rs, rt);
   // Register LO receives quotient
   lo = (ac_Sword) RB[rs] / (ac_Sword) RB[rt];
@@ -510,6 +830,7 @@ void ac_behavior( div )
 //!Instruction divu behavior method.
 void ac_behavior( divu )
 {
+  STATS_RETIRE(MIPS_DIVU);
   dbg_printf("divu r%d, r%d\n", rs, rt);
   // Register LO receives quotient
   lo = RB[rs] / RB[rt];
@@ -520,6 +841,7 @@ void ac_behavior( divu )
 //!Instruction mfhi behavior method.
 void ac_behavior( mfhi )
 {
+  STATS_RETIRE(MIPS_MFHI);
   dbg_printf("mfhi r%d\n", rd);
   RB[rd] = hi;
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -528,6 +850,7 @@ void ac_behavior( mfhi )
 //!Instruction mthi behavior method.
 void ac_behavior( mthi )
 {
+  STATS_RETIRE(MIPS_MTHI);
   dbg_printf("mthi r%d\n", rs);
   hi = RB[rs];
   dbg_printf("Result = %#x\n", (unsigned int) hi);
@@ -536,6 +859,7 @@ void ac_behavior( mthi )
 //!Instruction mflo behavior method.
 void ac_behavior( mflo )
 {
+  STATS_RETIRE(MIPS_MFLO);
   dbg_printf("mflo r%d\n", rd);
   RB[rd] = lo;
   dbg_printf("Result = %#x\n", RB[rd]);
@@ -544,6 +868,7 @@ void ac_behavior( mflo )
 //!Instruction mtlo behavior method.
 void ac_behavior( mtlo )
 {
+  STATS_RETIRE(MIPS_MTLO);
   dbg_printf("mtlo r%d\n", rs);
   lo = RB[rs];
   dbg_printf("Result = %#x\n", (unsigned int) lo);
@@ -552,6 +877,7 @@ void ac_behavior( mtlo )
 //!Instruction j behavior method.
 void ac_behavior( j )
 {
+  STATS_RETIRE(MIPS_J);
   dbg_printf("j %d\n", addr);
   addr = addr << 2;
 #ifndef NO_NEED_PC_UPDATE
@@ -563,6 +889,7 @@ void ac_behavior( j )
 //!Instruction jal behavior method.
 void ac_behavior( jal )
 {
+  STATS_RETIRE(MIPS_JAL);
   dbg_printf("jal %d\n", addr);
   // Save the value of PC + 8 (return address) in $ra ($31) and
   // jump to the address given by PC(31...28)||(addr<<2)
@@ -581,6 +908,8 @@ void ac_behavior( jal )
 //!Instruction jr behavior method.
 void ac_behavior( jr )
 {
+  STATS_RETIRE(MIPS_JR);
+  FUSE_LEARN(MIPS_JR, 0);
   dbg_printf("jr r%d\n", rs);
   // Jump to the address stored on the register reg[RS]
   // It must also flush the instructions that were loaded into the pipeline
@@ -593,6 +922,7 @@ void ac_behavior( jr )
 //!Instruction jalr behavior method.
 void ac_behavior( jalr )
 {
+  STATS_RETIRE(MIPS_JALR);
   dbg_printf("jalr r%d, r%d\n", rd, rs);
   // Save the value of PC + 8(return address) in rd and
   // jump to the address given by [rs]
@@ -611,6 +941,8 @@ void ac_behavior( jalr )
 //!Instruction beq behavior method.
 void ac_behavior( beq )
 {
+  STATS_RETIRE(MIPS_BEQ);
+  FUSE_LEARN(MIPS_BEQ, imm);
   dbg_printf("beq r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   if( RB[rs] == RB[rt] ){
 #ifndef NO_NEED_PC_UPDATE
@@ -623,6 +955,8 @@ void ac_behavior( beq )
 //!Instruction bne behavior method.
 void ac_behavior( bne )
 {	
+  STATS_RETIRE(MIPS_BNE);
+  FUSE_LEARN(MIPS_BNE, imm);
   dbg_printf("bne r%d, r%d, %d\n", rt, rs, imm & 0xFFFF);
   if( RB[rs] != RB[rt] ){
 #ifndef NO_NEED_PC_UPDATE
@@ -635,6 +969,7 @@ void ac_behavior( bne )
 //!Instruction blez behavior method.
 void ac_behavior( blez )
 {
+  STATS_RETIRE(MIPS_BLEZ);
   dbg_printf("blez r%d, %d\n", rs, imm & 0xFFFF);
   if( (RB[rs] == 0 ) || (RB[rs]&0x80000000 ) ){
 #ifndef NO_NEED_PC_UPDATE
@@ -647,6 +982,7 @@ void ac_behavior( blez )
 //!Instruction bgtz behavior method.
 void ac_behavior( bgtz )
 {
+  STATS_RETIRE(MIPS_BGTZ);
   dbg_printf("bgtz r%d, %d\n", rs, imm & 0xFFFF);
   if( !(RB[rs] & 0x80000000) && (RB[rs]!=0) ){
 #ifndef NO_NEED_PC_UPDATE
@@ -659,6 +995,7 @@ void ac_behavior( bgtz )
 //!Instruction bltz behavior method.
 void ac_behavior( bltz )
 {
+  STATS_RETIRE(MIPS_BLTZ);
   dbg_printf("bltz r%d, %d\n", rs, imm & 0xFFFF);
   if( RB[rs] & 0x80000000 ){
 #ifndef NO_NEED_PC_UPDATE
@@ -671,6 +1008,7 @@ void ac_behavior( bltz )
 //!Instruction bgez behavior method.
 void ac_behavior( bgez )
 {
+  STATS_RETIRE(MIPS_BGEZ);
   dbg_printf("bgez r%d, %d\n", rs, imm & 0xFFFF);
   if( !(RB[rs] & 0x80000000) ){
 #ifndef NO_NEED_PC_UPDATE
@@ -683,6 +1021,7 @@ void ac_behavior( bgez )
 //!Instruction bltzal behavior method.
 void ac_behavior( bltzal )
 {
+  STATS_RETIRE(MIPS_BLTZAL);
   dbg_printf("bltzal r%d, %d\n", rs, imm & 0xFFFF);
   RB[Ra] = ac_pc+4; //ac_pc is pc+4, we need pc+8
   if( RB[rs] & 0x80000000 ){
@@ -697,6 +1036,7 @@ void ac_behavior( bltzal )
 //!Instruction bgezal behavior method.
 void ac_behavior( bgezal )
 {
+  STATS_RETIRE(MIPS_BGEZAL);
   dbg_printf("bgezal r%d, %d\n", rs, imm & 0xFFFF);
   RB[Ra] = ac_pc+4; //ac_pc is pc+4, we need pc+8
   if( !(RB[rs] & 0x80000000) ){
@@ -711,13 +1051,39 @@ void ac_behavior( bgezal )
 //!Instruction sys_call behavior method.
 void ac_behavior( sys_call )
 {
+  STATS_RETIRE(MIPS_SYSCALL);
+  TRACE_SYSCALL();
   dbg_printf("syscall\n");
+#ifdef GUEST_THREADS
+  if (RB[2] >= THREAD_SYS_CREATE && RB[2] <= THREAD_SYS_LAST) {
+    thread_context ctx;
+    for (int i = 0; i < 32; i++)
+      ctx.regs[i] = RB[i];
+    ctx.hi = hi;
+    ctx.lo = lo;
+    ctx.pc = ac_pc;
+    if (threads.idle(&RB, ctx))
+      ac_instr_counter--;    // a parked core is not executing the program
+    if (!threads.syscall(&RB, ctx, DATA_PORT)) {
+      stop();
+      return;
+    }
+    for (int i = 0; i < 32; i++)
+      RB[i] = ctx.regs[i];
+    hi = ctx.hi;
+    lo = ctx.lo;
+    ac_pc = ctx.pc;
+    npc = ac_pc + 4;
+    return;
+  }
+#endif
   stop();
 }
 
 //!Instruction instr_break behavior method.
 void ac_behavior( instr_break )
 {
+  STATS_RETIRE(MIPS_BREAK);
   fprintf(stderr, "instr_break behavior not implemented.\n"); 
   exit(EXIT_FAILURE);
 }
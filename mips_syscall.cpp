@@ -34,6 +34,15 @@
  */
 
 #include "mips_syscall.H"
+#include "mips_memmap.H"
+
+#ifdef LIVE_STATS
+#include "mips_stats.H"
+#endif
+
+#ifdef ASYNC_IO
+#include "mips_io.H"
+#endif
 
 // 'using namespace' statement to allow access to all
 // mips-specific datatypes
@@ -82,6 +91,9 @@ void mips_syscall::set_int(int argn, int val)
 
 void mips_syscall::return_from_syscall()
 {
+#ifdef LIVE_STATS
+  mips_stats_shm::incr(mips_stats_shm::instance().slot_for(&RB)->syscalls);
+#endif
   ac_pc = RB[31];
   npc = ac_pc + 4;
 }
@@ -95,7 +107,7 @@ void mips_syscall::set_prog_args(int argc, char **argv)
   unsigned int ac_argv[30];
   char ac_argstr[512];
 
-  base = AC_RAM_END - 512 - procNumber * 64 * 1024;
+  base = mips_memmap::instance(AC_RAM_END).args_top(procNumber) - MEMMAP_ARGSTR_SIZE;
   for (i=0, j=0; i<argc; i++) {
     int len = strlen(argv[i]) + 1;
     ac_argv[i] = base + j;
@@ -121,5 +133,93 @@ void mips_syscall::set_prog_args(int argc, char **argv)
   procNumber ++;
 }
 
+#ifdef ASYNC_IO
+// Guest buffers go through this one, IO_CHUNK_SIZE bytes at a time:
+// the size is the guest's choice and cores only run one at a time
+static unsigned char io_buffer[IO_CHUNK_SIZE];
+
+void mips_syscall::write()
+{
+  int fd = get_int(0);
+  unsigned int addr = get_int(1);
+  unsigned int count = get_int(2);
+  unsigned int done = 0;
+  long ret = 0;
+
+  while (done < count) {
+    unsigned int size = std::min(count - done, (unsigned int) IO_CHUNK_SIZE);
+    for (unsigned int i = 0; i < size; i++)
+      io_buffer[i] = DATA_PORT->read_byte(addr + done + i);
+    ret = mips_async_io::instance().write(&RB, fd, io_buffer, size);
+    if (ret <= 0)
+      break;
+    done += ret;
+    if (ret < (long) size)
+      break;
+  }
+  set_int(0, done ? (long) done : ret);
+  return_from_syscall();
+}
+
+void mips_syscall::read()
+{
+  int fd = get_int(0);
+  unsigned int count = get_int(2);
+
+  // A shorter read is always allowed
+  long ret = mips_async_io::instance().read(&RB, fd, io_buffer,
+                                            std::min(count, (unsigned int) IO_CHUNK_SIZE));
+  if (ret > 0)
+    set_buffer(1, io_buffer, ret);
+  set_int(0, ret);
+  return_from_syscall();
+}
+
+// The other calls on a file first drain its pending I/O
+
+void mips_syscall::lseek()
+{
+  mips_async_io::instance().sync(get_int(0));
+  ac_syscall<ac_word, ac_Hword>::lseek();
+}
+
+void mips_syscall::close()
+{
+  int error = mips_async_io::instance().close(get_int(0));
+  ac_syscall<ac_word, ac_Hword>::close();
+  // A failed write-behind or console flush fails the close, as on NFS
+  if (error)
+    set_int(0, -1);
+}
+
+void mips_syscall::fstat()
+{
+  mips_async_io::instance().sync(get_int(0));
+  ac_syscall<ac_word, ac_Hword>::fstat();
+}
+
+void mips_syscall::exit()
+{
+  mips_async_io::instance().exit(&RB);
+  ac_syscall<ac_word, ac_Hword>::exit();
+}
+#endif
 
+#ifdef GUEST_THREADS
+// Threads of one program run on every core and share its address space,
+// so the break is one for the process instead of the ac_heap_ptr of each
+// core. Every core starts it at the same program end.
+static unsigned int heap_ptr;
 
+void mips_syscall::sbrk()
+{
+  if (!heap_ptr)
+    heap_ptr = ac_heap_ptr;
+  int increment = get_int(0);
+  unsigned int base = heap_ptr;
+  heap_ptr += increment;
+  ac_heap_ptr = heap_ptr;
+  set_int(0, base);
+  return_from_syscall();
+}
+#endif
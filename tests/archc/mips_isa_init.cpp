@@ -0,0 +1 @@
+// Stand-in for the acsim generated ISA initialization, see mips_isa.H.
@@ -0,0 +1,465 @@
+/**
+ * @file      test_batch.cpp
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     mips_batch lanes against the ac_behavior reference.
+ *
+ * Runs one program on every lane of a batch, each lane with its own
+ * inputs so the lanes split and merge on data dependent branches, and
+ * on the reference interpreter (mips_ref.H) with the same inputs. The
+ * registers, pc and memory of each lane must match its reference run.
+ * Some lanes rewrite an instruction ahead of them, which only they must
+ * execute.
+ *
+ * The batch runs twice: decoding every fetch, and from the predecode
+ * table of an ELF written to a temporary cache directory. Then a few
+ * lanes overflow in add and addi with the destination also a source.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mips_asm.H"
+#include "mips_ref.H"
+#include "mips_batch.H"
+
+using namespace mips_parms;
+
+#define LANES      16
+#define TEXT_BASE  0x1000
+#define DATA_BASE  0x10000
+#define MAX_INSTRS 100000
+
+// o32 register names
+enum { zero, at, v0, v1, a0, a1, a2, a3, t0, t1, t2, t3, t4, t5, t6, t7,
+       s0, s1, s2, s3, s4, s5, s6, s7, t8, t9, k0, k1, gp, sp, fp, ra };
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond)) {                              \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);             \
+      fprintf(stderr, "\n");                    \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+//! Two pass assembler: the first pass finds the labels, the second
+//! encodes with them.
+struct test_asm {
+  std::vector<uint32_t> words;
+  std::map<std::string, uint32_t> labels, known;
+
+  uint32_t pc() const { return TEXT_BASE + 4 * words.size(); }
+  void label(const char* name) { labels[name] = pc(); }
+  uint32_t at(const char* name)
+  {
+    std::map<std::string, uint32_t>::iterator it = known.find(name);
+    return it != known.end() ? it->second : pc();
+  }
+  void emit(uint32_t w) { words.push_back(w); }
+  void li(uint32_t r, uint32_t v)
+  {
+    emit(asm_i(MIPS_LUI, r, 0, v >> 16));
+    emit(asm_i(MIPS_ORI, r, r, v & 0xFFFF));
+  }
+  void b(uint8_t id, uint32_t rs, uint32_t rt, const char* target)
+  {
+    emit(asm_b(id, rs, rt, pc(), at(target)));
+  }
+};
+
+static void program(test_asm& p)
+{
+  uint32_t patch_word = asm_i(MIPS_ADDIU, v0, v0, 1000);
+
+  // Lanes with a2 == 0 rewrite the instruction at "patch"
+  p.b(MIPS_BNE, a2, zero, "nopatch");
+  p.emit(0);
+  p.li(t0, patch_word);
+  p.li(t1, p.at("patch"));
+  p.emit(asm_i(MIPS_SW, t0, t1, 0));
+  p.label("nopatch");
+  p.label("patch");
+  p.emit(asm_i(MIPS_ADDIU, v0, v0, 1));
+
+  // Loop with a data dependent branch
+  p.emit(asm_i(MIPS_LUI, s0, 0, DATA_BASE >> 16));
+  p.emit(asm_i(MIPS_ADDIU, t0, zero, 0));
+  p.emit(asm_i(MIPS_ADDIU, t1, zero, 24));
+  p.emit(asm_r(MIPS_ADDU, v1, zero, zero));
+  p.label("loop");
+  p.emit(asm_shift(MIPS_SLL, t2, t0, 2));
+  p.emit(asm_r(MIPS_ADDU, t3, s0, t2));
+  p.emit(asm_r(MIPS_XOR, t4, a0, t0));
+  p.emit(asm_r(MIPS_MULTU, 0, t4, a1));
+  p.emit(asm_r(MIPS_MFLO, t5, 0, 0));
+  p.emit(asm_r(MIPS_MFHI, t6, 0, 0));
+  p.emit(asm_i(MIPS_SW, t5, t3, 0));
+  p.emit(asm_i(MIPS_ANDI, t7, t4, 1));
+  p.b(MIPS_BEQ, t7, zero, "even");
+  p.emit(asm_shift(MIPS_SRA, t6, t6, 1));
+  p.emit(asm_shift(MIPS_SRA, t5, t5, 3));
+  p.emit(asm_r(MIPS_SLTU, t8, t5, a1));
+  p.emit(asm_r(MIPS_ADDU, v1, v1, t8));
+  p.emit(asm_i(MIPS_SB, t6, t3, 3));
+  p.emit(asm_shift(MIPS_SRL, a0, a0, 1));
+  p.label("even");
+  p.emit(asm_i(MIPS_ADDIU, t0, t0, 1));
+  p.emit(asm_r(MIPS_SLT, t9, t0, t1));
+  p.b(MIPS_BNE, t9, zero, "loop");
+  p.emit(asm_r(MIPS_SUBU, v0, v0, t5));
+
+  // Unaligned and sub-word accesses at lane dependent offsets, over
+  // words that are not zero so the merges show
+  p.emit(asm_i(MIPS_SW, a1, s0, 0x100));
+  p.emit(asm_i(MIPS_SW, t5, s0, 0x104));
+  p.emit(asm_i(MIPS_SW, a0, s0, 0x108));
+  p.emit(asm_i(MIPS_SW, t6, s0, 0x10C));
+  p.emit(asm_i(MIPS_ANDI, t0, a0, 7));
+  p.emit(asm_r(MIPS_ADDU, t1, s0, t0));
+  p.emit(asm_i(MIPS_SWL, a1, t1, 0x101));
+  p.emit(asm_i(MIPS_SWR, a0, t1, 0x106));
+  p.emit(asm_i(MIPS_LWL, s1, t1, 0x102));
+  p.emit(asm_i(MIPS_LWR, s1, t1, 0x105));
+  p.emit(asm_i(MIPS_LH, s2, s0, 0x106));
+  p.emit(asm_i(MIPS_LHU, s3, s0, 0x108));
+  p.emit(asm_i(MIPS_LB, s4, s0, 0x109));
+  p.emit(asm_i(MIPS_LBU, s5, s0, 0x10A));
+  p.emit(asm_i(MIPS_SH, a0, s0, 0x110));
+  p.emit(asm_i(MIPS_LW, t0, s0, 0x100));
+  p.emit(asm_r(MIPS_ADDU, v0, v0, t0));
+
+  // hi/lo
+  p.emit(asm_r(MIPS_DIV, 0, a0, a1));
+  p.emit(asm_r(MIPS_MFHI, s6, 0, 0));
+  p.emit(asm_r(MIPS_MFLO, s7, 0, 0));
+  p.emit(asm_r(MIPS_DIVU, 0, a0, a1));
+  p.emit(asm_r(MIPS_MFHI, t2, 0, 0));
+  p.emit(asm_r(MIPS_MFLO, t3, 0, 0));
+  p.emit(asm_r(MIPS_MULT, 0, a0, s1));
+  p.emit(asm_r(MIPS_MTHI, 0, t2, 0));
+  p.emit(asm_r(MIPS_MTLO, 0, t3, 0));
+
+  // Call with a stack frame
+  p.emit(asm_j(MIPS_JAL, p.at("func")));
+  p.emit(asm_i(MIPS_ADDIU, a3, zero, 5));
+
+  // Rest of the ALU
+  p.emit(asm_r(MIPS_SLLV, t4, a0, a2));
+  p.emit(asm_r(MIPS_SRLV, t5, a1, a0));
+  p.emit(asm_r(MIPS_SRAV, t6, a0, a1));
+  p.emit(asm_r(MIPS_NOR, t7, a0, a1));
+  p.emit(asm_r(MIPS_OR, t8, s1, s2));
+  p.emit(asm_r(MIPS_AND, t9, s3, a0));
+  p.emit(asm_i(MIPS_SLTI, at, a0, -100));
+  p.emit(asm_i(MIPS_SLTIU, gp, a0, 1000));
+  p.emit(asm_i(MIPS_XORI, fp, a0, 0x5A5A));
+  p.emit(asm_i(MIPS_ORI, a3, a3, 0x8000));
+  p.emit(asm_i(MIPS_ADDI, t0, a2, 3));
+  p.emit(asm_r(MIPS_ADD, t1, t0, a2));
+  p.emit(asm_r(MIPS_SUB, t2, a1, a2));
+
+  // Indirect jump that splits the lanes on a2, to a target that is not
+  // a block leader
+  p.emit(asm_i(MIPS_ANDI, t0, a2, 1));
+  p.emit(asm_i(MIPS_XORI, t0, t0, 1));
+  p.emit(asm_shift(MIPS_SLL, t0, t0, 2));
+  p.li(t1, p.at("jtab"));
+  p.emit(asm_r(MIPS_ADDU, t0, t0, t1));
+  p.emit(asm_r(MIPS_JR, 0, t0, 0));
+  p.emit(0);
+  p.label("jtab");
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 3));
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 5));
+
+  // The lanes split on the signs of a0 and a2
+  p.b(MIPS_BLTZ, a0, 0, "neg");
+  p.emit(0);
+  p.emit(asm_i(MIPS_ADDIU, v0, v0, 100));
+  p.label("neg");
+  p.b(MIPS_BGEZ, a0, 0, "nonneg");
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 1));
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 10));
+  p.label("nonneg");
+  p.b(MIPS_BLEZ, a2, 0, "skip");
+  p.emit(0);
+  p.emit(asm_i(MIPS_ADDIU, v0, v0, 1));
+  p.label("skip");
+  p.b(MIPS_BGTZ, a2, 0, "skip2");
+  p.emit(0);
+  p.emit(asm_i(MIPS_ADDIU, v0, v0, 2));
+  p.label("skip2");
+  p.b(MIPS_BLTZAL, a0, 0, "leaf");
+  p.emit(0);
+  p.b(MIPS_BGEZAL, a0, 0, "leaf");
+  p.emit(0);
+  p.li(t0, p.at("last"));
+  p.emit(asm_r(MIPS_JALR, ra, t0, 0));
+  p.emit(0);
+  p.emit(asm_j(MIPS_J, p.at("end")));
+  p.emit(0);
+  p.label("last");
+  p.emit(asm_i(MIPS_ADDIU, s0, s0, 4));
+  p.emit(asm_r(MIPS_JR, 0, ra, 0));
+  p.emit(0);
+  p.label("end");
+  p.emit(asm_r(MIPS_SYSCALL, 0, 0, 0));
+
+  p.label("func");
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, -16));
+  p.emit(asm_i(MIPS_SW, ra, sp, 12));
+  p.emit(asm_i(MIPS_SW, a3, sp, 8));
+  p.emit(asm_i(MIPS_LW, t0, sp, 8));
+  p.emit(asm_r(MIPS_ADDU, v0, v0, t0));
+  p.emit(asm_i(MIPS_LW, ra, sp, 12));
+  p.emit(asm_r(MIPS_JR, 0, ra, 0));
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, 16));
+
+  p.label("leaf");
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 7));
+  p.emit(asm_r(MIPS_JR, 0, ra, 0));
+  p.emit(0);
+}
+
+//! State of one run, reference or lane.
+struct run_state {
+  uint32_t regs[32];
+  uint32_t pc, hi, lo;
+  std::vector<uint8_t> data, stack;
+};
+
+//! Lanes of a batch against their reference runs.
+static void check_lanes(mips_batch& batch, const run_state* ref, uint32_t init[][32],
+                        const char* name)
+{
+  for (unsigned l = 0; l < LANES; l++) {
+    const run_state& s = ref[l];
+    CHECK(batch.status[l] == mips_batch::LANE_SYSCALL, "%s lane %u status %u", name, l,
+          batch.status[l]);
+    CHECK(batch.pc[l] == s.pc, "%s lane %u pc %#x, reference %#x", name, l, batch.pc[l], s.pc);
+    CHECK(batch.hi[l] == s.hi, "%s lane %u hi %#x, reference %#x", name, l, batch.hi[l], s.hi);
+    CHECK(batch.lo[l] == s.lo, "%s lane %u lo %#x, reference %#x", name, l, batch.lo[l], s.lo);
+    for (int r = 0; r < 32; r++)
+      CHECK(batch.RB[r][l] == s.regs[r], "%s lane %u r%d %#x, reference %#x", name, l, r,
+            batch.RB[r][l], s.regs[r]);
+    for (uint32_t i = 0; i < s.data.size(); i++)
+      CHECK(batch.lane_mem(l).read_byte(DATA_BASE + i) == s.data[i],
+            "%s lane %u byte %#x differs", name, l, DATA_BASE + i);
+    for (uint32_t i = 0; i < s.stack.size(); i++)
+      CHECK(batch.lane_mem(l).read_byte(init[l][sp] - 32 + i) == s.stack[i],
+            "%s lane %u stack byte %#x differs", name, l, init[l][sp] - 32 + i);
+  }
+
+  // Otherwise the program did not exercise the group handling
+  CHECK(batch.stats.splits > 0 && batch.stats.merges > 0 && batch.stats.divergent > 0,
+        "%s lanes never split (%llu splits, %llu merges)", name, batch.stats.splits,
+        batch.stats.merges);
+}
+
+//! Whether the reference stops program (with a0, a1, a2) by exiting with
+//! an overflow exception. It exits the process, so it runs in a child.
+static bool ref_overflows(const std::vector<uint8_t>& text, const uint32_t* args)
+{
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (freopen("/dev/null", "w", stderr) == NULL)
+      _exit(2);
+    mips_isa* m = new mips_isa;
+    for (size_t i = 0; i < text.size(); i++)
+      m->DATA_PORT->write_byte(TEXT_BASE + i, text[i]);
+    m->ac_pc = TEXT_BASE;
+    m->beh_begin();
+    for (int r = 0; r < 3; r++)
+      m->RB[a0 + r] = args[r];
+    ref_run(*m, MAX_INSTRS);
+    _exit(0);
+  }
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+         WEXITSTATUS(status) == EXIT_FAILURE;
+}
+
+//! add and addi with the destination also a source: the operands are
+//! tested before the write, so an overflow stops the lane at the
+//! instruction and a sum without overflow goes on.
+static void overflow_lanes()
+{
+  static const uint32_t words[] = {
+    asm_r(MIPS_ADD, a0, a0, a1),
+    asm_i(MIPS_ADDI, a2, a2, 0x7FFF),
+    asm_r(MIPS_SYSCALL, 0, 0, 0)
+  };
+  struct {
+    uint32_t args[3];                   // a0, a1, a2
+    uint8_t status;
+    uint32_t pc, a0, a2;
+  } lanes[] = {
+    { { 0x7FFFFFFF, 1, 0 },          mips_batch::LANE_FAULT,   TEXT_BASE + 4,  0x80000000, 0 },
+    { { 0x80000000, 0xFFFFFFFF, 0 }, mips_batch::LANE_FAULT,   TEXT_BASE + 4,  0x7FFFFFFF, 0 },
+    { { 5, 0xFFFFFFFD, 0x7FFFFFF0 }, mips_batch::LANE_FAULT,   TEXT_BASE + 8,  2, 0x80007FEF },
+    { { 1, 2, 1 },                   mips_batch::LANE_SYSCALL, TEXT_BASE + 12, 3, 0x8000 }
+  };
+  const unsigned n = sizeof(lanes) / sizeof(lanes[0]);
+
+  std::vector<uint8_t> text;
+  for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+    for (int k = 3; k >= 0; k--)
+      text.push_back(words[i] >> (8 * k));
+  mips_batch_image image;
+  image.load(TEXT_BASE, &text[0], text.size());
+  mips_batch batch(n, &image, TEXT_BASE, 0);
+  for (unsigned l = 0; l < n; l++)
+    for (int r = 0; r < 3; r++)
+      batch.RB[a0 + r][l] = lanes[l].args[r];
+  batch.run(MAX_INSTRS);
+
+  for (unsigned l = 0; l < n; l++) {
+    CHECK(batch.status[l] == lanes[l].status && batch.pc[l] == lanes[l].pc,
+          "overflow lane %u status %u pc %#x, expected %u %#x", l, batch.status[l],
+          batch.pc[l], lanes[l].status, lanes[l].pc);
+    CHECK(batch.RB[a0][l] == lanes[l].a0 && batch.RB[a2][l] == lanes[l].a2,
+          "overflow lane %u a0 %#x a2 %#x, expected %#x %#x", l, batch.RB[a0][l],
+          batch.RB[a2][l], lanes[l].a0, lanes[l].a2);
+  }
+  // Where the reference tests the overflow too (see mips_batch.H)
+  CHECK(ref_overflows(text, lanes[0].args) && ref_overflows(text, lanes[1].args),
+        "reference add rd == rs did not overflow");
+  CHECK(!ref_overflows(text, lanes[3].args), "reference overflowed without an overflow");
+}
+
+static void put32(std::vector<uint8_t>& f, size_t at, uint32_t v)
+{
+  for (int k = 0; k < 4; k++)
+    f[at + k] = v >> (24 - 8 * k);
+}
+
+//! Big-endian ELF32 executable with text as its only segment.
+static bool write_elf(const char* file, const std::vector<uint8_t>& text)
+{
+  std::vector<uint8_t> f(84, 0);
+  memcpy(&f[0], "\177ELF\1\2\1", 7);
+  put32(f, 16, 0x00020008);             // ET_EXEC, EM_MIPS
+  put32(f, 20, 1);
+  put32(f, 24, TEXT_BASE);
+  put32(f, 28, 52);                     // e_phoff
+  put32(f, 40, (52 << 16) | 32);        // e_ehsize, e_phentsize
+  put32(f, 44, 1 << 16);                // e_phnum
+  put32(f, 52, ELF_PT_LOAD);
+  put32(f, 56, 84);                     // p_offset
+  put32(f, 60, TEXT_BASE);
+  put32(f, 64, TEXT_BASE);
+  put32(f, 68, text.size());
+  put32(f, 72, text.size());
+  put32(f, 76, ELF_PF_X | 4);
+  f.insert(f.end(), text.begin(), text.end());
+
+  FILE* out = fopen(file, "wb");
+  bool ok = out && fwrite(&f[0], 1, f.size(), out) == f.size();
+  return out && fclose(out) == 0 && ok;
+}
+
+int main()
+{
+  test_asm p;
+  program(p);
+  p.known = p.labels;
+  p.words.clear();
+  p.labels.clear();
+  program(p);
+
+  std::vector<uint8_t> text;
+  for (size_t i = 0; i < p.words.size(); i++)
+    for (int k = 3; k >= 0; k--)
+      text.push_back(p.words[i] >> (8 * k));
+
+  srandom(1);
+  uint32_t init[LANES][32];
+  run_state ref[LANES];
+  for (unsigned l = 0; l < LANES; l++) {
+    mips_isa* m = new mips_isa;
+    for (size_t i = 0; i < text.size(); i++)
+      m->DATA_PORT->write_byte(TEXT_BASE + i, text[i]);
+    m->ac_pc = TEXT_BASE;
+    m->beh_begin();
+    m->RB[a0] = (uint32_t) random() ^ ((uint32_t) random() << 16);
+    m->RB[a1] = ((uint32_t) random() | 1) & 0x7FFFFFFF;
+    m->RB[a2] = l % 4 == 0 ? 0 : (l % 4 == 1 ? 0xFFFFFFF0 : l);
+    for (int r = 0; r < 32; r++)
+      init[l][r] = m->RB[r];
+
+    CHECK(ref_run(*m, MAX_INSTRS), "reference lane %u did not reach the syscall", l);
+    run_state& s = ref[l];
+    for (int r = 0; r < 32; r++)
+      s.regs[r] = m->RB[r];
+    s.pc = m->ac_pc;
+    s.hi = m->hi;
+    s.lo = m->lo;
+    for (uint32_t a = DATA_BASE; a < DATA_BASE + 0x200; a++)
+      s.data.push_back(m->DATA_PORT->read_byte(a));
+    for (uint32_t a = init[l][sp] - 32; a < init[l][sp]; a++)
+      s.stack.push_back(m->DATA_PORT->read_byte(a));
+    delete m;
+  }
+
+  mips_batch_image image;
+  image.load(TEXT_BASE, &text[0], text.size());
+  mips_batch batch(LANES, &image, TEXT_BASE, 0);
+  for (unsigned l = 0; l < LANES; l++)
+    for (int r = 0; r < 32; r++)
+      batch.RB[r][l] = init[l][r];
+  batch.run(MAX_INSTRS);
+  check_lanes(batch, ref, init, "decode");
+
+  // The same program from its predecode table: built on the first load,
+  // mapped from the cache on the second
+  char dir[] = "/tmp/test_batch.XXXXXX";
+  CHECK(mkdtemp(dir) != NULL, "mkdtemp");
+  std::string elf = std::string(dir) + "/prog.elf";
+  CHECK(write_elf(elf.c_str(), text), "cannot write %s", elf.c_str());
+  setenv("MIPS_PREDECODE_DIR", dir, 1);
+  mips_predecode first, table;
+  CHECK(first.load(elf.c_str()) && !first.from_cache, "predecode table not built");
+  CHECK(table.load(elf.c_str()) && table.from_cache, "predecode table not cached");
+  CHECK(table.leader(TEXT_BASE) && table.leader(p.known["loop"]) &&
+        table.leader(p.known["even"]) && !table.leader(p.known["loop"] + 4),
+        "wrong block leaders");
+
+  mips_batch pbatch(LANES, &image, TEXT_BASE, 0);
+  pbatch.set_predecode(&table);
+  for (unsigned l = 0; l < LANES; l++)
+    for (int r = 0; r < 32; r++)
+      pbatch.RB[r][l] = init[l][r];
+  pbatch.run(MAX_INSTRS);
+  check_lanes(pbatch, ref, init, "predecode");
+  CHECK(pbatch.stats.steps == batch.stats.steps, "predecode ran %llu steps, decode %llu",
+        pbatch.stats.steps, batch.stats.steps);
+  if (system((std::string("rm -rf ") + dir).c_str()) != 0)
+    fprintf(stderr, "test_batch: cannot remove %s\n", dir);
+
+  overflow_lanes();
+
+  if (failures) {
+    fprintf(stderr, "test_batch: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("test_batch: ok, %u lanes, %llu steps for %llu lane instructions\n", LANES,
+         batch.stats.steps, batch.stats.lane_instrs);
+  return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file      test_decode.cpp
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     Round trips between mips_decode.H and the test encoder.
+ *
+ * Every id encodes and decodes back with its fields and flags, and every
+ * word the decoder accepts encodes back to itself.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mips_asm.H"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond)) {                              \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);             \
+      fprintf(stderr, "\n");                    \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+static uint32_t rnd()
+{
+  return (uint32_t) random() ^ ((uint32_t) random() << 16);
+}
+
+//! Flags the decoder must give id.
+static uint8_t expected_flags(uint8_t id)
+{
+  if (id >= MIPS_LB && id <= MIPS_LWR)
+    return MIPS_DEC_LOAD;
+  if (id >= MIPS_SB && id <= MIPS_SWR)
+    return MIPS_DEC_STORE;
+  if (id == MIPS_J || id == MIPS_JAL || id == MIPS_JR || id == MIPS_JALR)
+    return MIPS_DEC_JUMP;
+  if (id >= MIPS_BEQ && id <= MIPS_BGEZAL)
+    return MIPS_DEC_BRANCH;
+  if (id == MIPS_SYSCALL || id == MIPS_BREAK)
+    return MIPS_DEC_TRAP;
+  return 0;
+}
+
+//! Encode every id with random fields and decode it back.
+static void test_ids()
+{
+  for (uint8_t id = MIPS_LB; id <= MIPS_NUM_INSTR; id++)
+    for (int n = 0; n < 1000; n++) {
+      uint32_t rs = rnd() & 0x1F, rt = rnd() & 0x1F, rd = rnd() & 0x1F;
+      uint32_t shamt = rnd() & 0x1F, addr = rnd() & 0x3FFFFFF;
+      int32_t imm = (int16_t) rnd();
+      // Encodings that select another id
+      if (id == MIPS_LUI)
+        rs = 0;
+      if (id == MIPS_NOP)
+        rd = 0;
+      if (id == MIPS_SLL && rd == 0)
+        rd = 1;
+
+      uint32_t word = asm_encode(id, rs, rt, rd, shamt, imm, addr);
+      mips_decoded d = mips_decode(word);
+      asm_encoding e = asm_encoding_of(id);
+
+      CHECK(d.id == id, "%s (%08x) decodes as %s", mips_instr_name[id], word,
+            mips_instr_name[d.id]);
+      CHECK(d.flags == expected_flags(id), "%s flags %#x", mips_instr_name[id], d.flags);
+      CHECK(d.op == e.op, "%s op %#x", mips_instr_name[id], d.op);
+      if (e.format == ASM_J) {
+        CHECK(d.addr == addr, "%s addr %#x, expected %#x", mips_instr_name[id], d.addr, addr);
+        continue;
+      }
+      CHECK(d.rs == rs, "%s rs %u, expected %u", mips_instr_name[id], d.rs, rs);
+      if (e.rt < 0)
+        CHECK(d.rt == rt, "%s rt %u, expected %u", mips_instr_name[id], d.rt, rt);
+      if (e.format == ASM_R) {
+        CHECK(d.rd == rd, "%s rd %u, expected %u", mips_instr_name[id], d.rd, rd);
+        CHECK(d.shamt == shamt, "%s shamt %u", mips_instr_name[id], d.shamt);
+        CHECK(d.func == e.func, "%s func %#x", mips_instr_name[id], d.func);
+      }
+      else
+        CHECK(d.imm == imm, "%s imm %d, expected %d", mips_instr_name[id], d.imm, imm);
+    }
+}
+
+//! Every word the decoder accepts is the encoding of what it decoded.
+static void test_words()
+{
+  unsigned long valid = 0;
+  for (int n = 0; n < 2000000; n++) {
+    uint32_t word = rnd();
+    // Bias half of the words towards the op=0 and REGIMM spaces
+    if (n & 1)
+      word &= (n & 2) ? 0x03FFFFFF : 0x07FFFFFF;
+    mips_decoded d = mips_decode(word);
+    if (d.id == MIPS_INVALID) {
+      CHECK(d.flags == MIPS_DEC_TRAP, "invalid %08x flags %#x", word, d.flags);
+      continue;
+    }
+    valid++;
+    uint32_t again = asm_encode(d.id, d.rs, d.rt, d.rd, d.shamt, d.imm, d.addr);
+    CHECK(again == word, "%08x decodes as %s, which encodes as %08x", word,
+          mips_instr_name[d.id], again);
+  }
+  CHECK(valid > 100000, "only %lu valid words", valid);
+}
+
+int main()
+{
+  srandom(1);
+  test_ids();
+  test_words();
+  if (failures) {
+    fprintf(stderr, "test_decode: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("test_decode: ok\n");
+  return 0;
+}
@@ -0,0 +1,318 @@
+/**
+ * @file      test_fusion.cpp
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     FUSE_IDIOMS build of mips_isa.cpp against the plain one.
+ *
+ * Runs a loop of lui, slt/sltu + branch, prologue and epilogue idioms,
+ * with their $zero and zero immediate variants, on both builds in
+ * lockstep: after every step of the fused build the plain one runs as
+ * many instructions, and pc, npc, registers, hi/lo and the instruction
+ * counter must match. Memory is compared at the end. The first pass
+ * learns the followers, the next ones fuse them; one pass rewrites a
+ * learned instruction, which must then run as written.
+ *
+ * The fused build is mips_isa.cpp compiled with the mips_parms
+ * namespace renamed, so both link into this test.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mips_asm.H"
+#include "mips_ref.H"
+
+// The stand-in ISA class again, for the build with -Dmips_parms=mips_fused_parms
+#undef TEST_MIPS_ISA_H
+#define mips_parms mips_fused_parms
+#include "mips_isa.H"
+#undef mips_parms
+
+typedef mips_parms::mips_isa plain_isa;
+typedef mips_fused_parms::mips_isa fused_isa;
+
+#define TEXT_BASE  0x1000
+#define DATA_BASE  0x10000
+#define ZERO_BASE  0x20000
+#define PASSES     4
+#define MAX_STEPS  10000
+
+// o32 register names
+enum { zero, at, v0, v1, a0, a1, a2, a3, t0, t1, t2, t3, t4, t5, t6, t7,
+       s0, s1, s2, s3, s4, s5, s6, s7, t8, t9, k0, k1, gp, sp, fp, ra };
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond)) {                              \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);             \
+      fprintf(stderr, "\n");                    \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+//! Two pass assembler: the first pass finds the labels, the second
+//! encodes with them.
+struct test_asm {
+  std::vector<uint32_t> words;
+  std::map<std::string, uint32_t> labels, known;
+
+  uint32_t pc() const { return TEXT_BASE + 4 * words.size(); }
+  void label(const char* name) { labels[name] = pc(); }
+  uint32_t at(const char* name)
+  {
+    std::map<std::string, uint32_t>::iterator it = known.find(name);
+    return it != known.end() ? it->second : pc();
+  }
+  void emit(uint32_t w) { words.push_back(w); }
+  void b(uint8_t id, uint32_t rs, uint32_t rt, const char* target)
+  {
+    emit(asm_b(id, rs, rt, pc(), at(target)));
+  }
+};
+
+//! Idioms whose first instruction must have fused on a later pass.
+static const char* const fusing[] = {
+  "lui_ori", "lui_ori0", "lui_addiu", "lui_addiu0", "lui_lw", "lui_lw0", "lui_lw_self",
+  "lui_sw", "lui_sw0", "lui_swz", "lui_swz0",
+  "slt_bne0", "sltu_beq0", "slt_beq", "sltu_bne",
+  "prologue", "prologue_z", "prologue_0", "prologue_1", "epilogue", "epilogue_jr"
+};
+
+//! And the ones that must not.
+static const char* const plain[] = { "slt_other", "lui_other" };
+
+static void program(test_asm& p)
+{
+  uint32_t patch_word = asm_i(MIPS_ORI, t0, t0, 0x9999);
+
+  p.label("loop");
+  p.label("lui_ori");
+  p.emit(asm_i(MIPS_LUI, t0, 0, 0x1234));
+  p.label("ori");
+  p.emit(asm_i(MIPS_ORI, t0, t0, 0x5678));
+  p.label("lui_ori0");
+  p.emit(asm_i(MIPS_LUI, t1, 0, 0x4321));
+  p.emit(asm_i(MIPS_ORI, t1, t1, 0));
+  p.label("lui_addiu");
+  p.emit(asm_i(MIPS_LUI, t2, 0, 0x1234));
+  p.emit(asm_i(MIPS_ADDIU, t2, t2, -5));
+  p.label("lui_addiu0");
+  p.emit(asm_i(MIPS_LUI, t3, 0, 0x8000));
+  p.emit(asm_i(MIPS_ADDIU, t3, t3, 0));
+  p.label("lui_lw");
+  p.emit(asm_i(MIPS_LUI, at, 0, DATA_BASE >> 16));
+  p.emit(asm_i(MIPS_LW, t4, at, 8));
+  p.label("lui_lw0");
+  p.emit(asm_i(MIPS_LUI, at, 0, DATA_BASE >> 16));
+  p.emit(asm_i(MIPS_LW, t5, at, 0));
+  p.label("lui_lw_self");
+  p.emit(asm_i(MIPS_LUI, at, 0, DATA_BASE >> 16));
+  p.emit(asm_i(MIPS_LW, at, at, 12));
+  p.label("lui_sw");
+  p.emit(asm_i(MIPS_LUI, at, 0, DATA_BASE >> 16));
+  p.emit(asm_i(MIPS_SW, t0, at, 16));
+  p.label("lui_sw0");
+  p.emit(asm_i(MIPS_LUI, at, 0, DATA_BASE >> 16));
+  p.emit(asm_i(MIPS_SW, s0, at, 0));
+  p.label("lui_swz");
+  p.emit(asm_i(MIPS_LUI, at, 0, DATA_BASE >> 16));
+  p.emit(asm_i(MIPS_SW, zero, at, 20));
+  p.label("lui_swz0");
+  p.emit(asm_i(MIPS_LUI, at, 0, ZERO_BASE >> 16));
+  p.emit(asm_i(MIPS_SW, zero, at, 0));
+  // The follower does not use the register lui wrote
+  p.label("lui_other");
+  p.emit(asm_i(MIPS_LUI, at, 0, 0x7777));
+  p.emit(asm_i(MIPS_ORI, t9, t9, 0x11));
+
+  // s0 counts the passes down to 1, s1 = 2: the branches go both ways
+  p.label("slt_bne0");
+  p.emit(asm_r(MIPS_SLT, t6, s0, s1));
+  p.b(MIPS_BNE, t6, zero, "l1");
+  p.emit(asm_i(MIPS_ADDIU, v0, v0, 1));
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 1));
+  p.label("l1");
+  p.label("sltu_beq0");
+  p.emit(asm_r(MIPS_SLTU, t7, s1, s0));
+  p.b(MIPS_BEQ, zero, t7, "l2");
+  p.emit(0);
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 2));
+  p.label("l2");
+  p.label("slt_beq");
+  p.emit(asm_r(MIPS_SLT, t8, s0, s1));
+  p.b(MIPS_BEQ, t8, s2, "l3");
+  p.emit(0);
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 4));
+  p.label("l3");
+  p.label("sltu_bne");
+  p.emit(asm_r(MIPS_SLTU, t9, s0, s1));
+  p.b(MIPS_BNE, s3, t9, "l4");
+  p.emit(0);
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 8));
+  p.label("l4");
+  // The branch does not test the result
+  p.label("slt_other");
+  p.emit(asm_r(MIPS_SLT, t6, s0, s1));
+  p.b(MIPS_BNE, a0, zero, "l5");
+  p.emit(0);
+  p.emit(asm_i(MIPS_ADDIU, v1, v1, 16));
+  p.label("l5");
+
+  p.emit(asm_j(MIPS_JAL, p.at("func")));
+  p.emit(0);
+  p.emit(asm_j(MIPS_JAL, p.at("leaf")));
+  p.emit(0);
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, 8));
+
+  // Rewrite the ori once, after the first pass, through lui+ori and
+  // lui+sw: the next pass learns it again and the last ones fuse it
+  p.emit(asm_i(MIPS_ADDIU, at, s0, -PASSES));
+  p.b(MIPS_BNE, at, zero, "patched");
+  p.emit(0);
+  p.emit(asm_i(MIPS_LUI, k0, 0, patch_word >> 16));
+  p.emit(asm_i(MIPS_ORI, k0, k0, patch_word & 0xFFFF));
+  p.emit(asm_i(MIPS_LUI, k1, 0, 0));
+  p.emit(asm_i(MIPS_SW, k0, k1, p.at("ori")));
+  p.label("patched");
+
+  p.emit(asm_i(MIPS_ADDIU, s0, s0, -1));
+  p.b(MIPS_BNE, s0, zero, "loop");
+  p.emit(0);
+  p.emit(asm_r(MIPS_SYSCALL, 0, 0, 0));
+
+  p.label("func");
+  p.label("prologue");
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, -16));
+  p.emit(asm_i(MIPS_SW, ra, sp, 12));
+  p.emit(asm_i(MIPS_SW, zero, sp, 0));
+  p.label("prologue_z");
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, -8));
+  p.emit(asm_i(MIPS_SW, zero, sp, 4));
+  p.emit(asm_r(MIPS_ADDU, v0, v0, s0));
+  p.label("prologue_0");
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, -8));
+  p.emit(asm_i(MIPS_SW, s1, sp, 0));
+  p.emit(asm_i(MIPS_SW, s0, sp, 4));
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, 16));
+  p.label("epilogue");
+  p.emit(asm_i(MIPS_LW, ra, sp, 12));
+  p.emit(asm_r(MIPS_JR, 0, ra, 0));
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, 16));
+
+  // Returns with its frame, popped by the caller
+  p.label("leaf");
+  p.label("prologue_1");
+  p.emit(asm_i(MIPS_ADDIU, sp, sp, -8));
+  p.emit(asm_i(MIPS_SW, ra, sp, 4));
+  p.label("epilogue_jr");
+  p.emit(asm_i(MIPS_LW, ra, sp, 4));
+  p.emit(asm_r(MIPS_JR, 0, ra, 0));
+  p.emit(0);
+}
+
+//! Same state in both builds.
+static void check_state(plain_isa& r, fused_isa& f, uint32_t pc)
+{
+  CHECK(f.ac_instr_counter == r.ac_instr_counter, "after %#x: counter %llu, plain %llu", pc,
+        f.ac_instr_counter, r.ac_instr_counter);
+  CHECK(f.ac_pc == r.ac_pc && f.npc == r.npc, "after %#x: pc %#x npc %#x, plain %#x %#x", pc,
+        f.ac_pc, f.npc, r.ac_pc, r.npc);
+  CHECK(f.hi == r.hi && f.lo == r.lo, "after %#x: hi/lo differ", pc);
+  for (int i = 0; i < 32; i++)
+    CHECK(f.RB[i] == r.RB[i], "after %#x: r%d %#x, plain %#x", pc, i, f.RB[i], r.RB[i]);
+}
+
+static void check_memory(plain_isa& r, fused_isa& f, uint32_t from, uint32_t size,
+                         const char* what)
+{
+  for (uint32_t a = from; a < from + size; a++)
+    if (f.DATA_PORT->read_byte(a) != r.DATA_PORT->read_byte(a)) {
+      CHECK(false, "%s at %#x: %#x, plain %#x", what, a, f.DATA_PORT->read_byte(a),
+            r.DATA_PORT->read_byte(a));
+      return;
+    }
+}
+
+template <class ISA>
+static void setup(ISA& m, const std::vector<uint32_t>& words)
+{
+  for (size_t i = 0; i < words.size(); i++)
+    m.DATA_PORT->write(TEXT_BASE + 4 * i, words[i]);
+  for (uint32_t i = 0; i < 16; i++)
+    m.DATA_PORT->write(DATA_BASE + 4 * i, 0x01020304 * (i + 1));
+  m.DATA_PORT->write(ZERO_BASE, 0xDEADBEEF);
+  m.ac_pc = TEXT_BASE;
+  m.beh_begin();
+  m.RB[s0] = PASSES;
+  m.RB[s1] = 2;
+  m.RB[s2] = 1;
+}
+
+int main()
+{
+  test_asm p;
+  program(p);
+  p.known = p.labels;
+  p.words.clear();
+  p.labels.clear();
+  program(p);
+
+  plain_isa* r = new plain_isa;
+  fused_isa* f = new fused_isa;
+  setup(*r, p.words);
+  setup(*f, p.words);
+  uint32_t sp_top = r->RB[sp];
+  check_state(*r, *f, 0);
+
+  // Addresses of the steps that retired more than one instruction
+  std::set<uint32_t> fused;
+  unsigned int steps = 0;
+  while (!f->stopped && steps < MAX_STEPS && !failures) {
+    uint32_t pc = f->ac_pc;
+    unsigned long long before = f->ac_instr_counter;
+    CHECK(ref_step(*f), "fused build: invalid instruction at %#x", pc);
+    steps++;
+    if (f->ac_instr_counter > before + 1)
+      fused.insert(pc);
+    while (r->ac_instr_counter < f->ac_instr_counter && !r->stopped)
+      CHECK(ref_step(*r), "plain build: invalid instruction at %#x", r->ac_pc);
+    check_state(*r, *f, pc);
+  }
+  CHECK(f->stopped && r->stopped, "the builds did not reach the syscall");
+
+  check_memory(*r, *f, TEXT_BASE, 4 * p.words.size(), "text");
+  check_memory(*r, *f, DATA_BASE, 64, "data");
+  check_memory(*r, *f, ZERO_BASE, 4, "data");
+  check_memory(*r, *f, sp_top - 64, 64, "stack");
+  CHECK(r->DATA_PORT->read(p.labels["ori"]) == asm_i(MIPS_ORI, t0, t0, 0x9999),
+        "the ori was not rewritten");
+
+  for (size_t i = 0; i < sizeof(fusing) / sizeof(fusing[0]); i++)
+    CHECK(fused.count(p.labels[fusing[i]]), "%s did not fuse", fusing[i]);
+  for (size_t i = 0; i < sizeof(plain) / sizeof(plain[0]); i++)
+    CHECK(!fused.count(p.labels[plain[i]]), "%s fused", plain[i]);
+
+  if (failures) {
+    fprintf(stderr, "test_fusion: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("test_fusion: ok, %u steps for %llu instructions\n", steps, r->ac_instr_counter);
+  delete r;
+  delete f;
+  return 0;
+}
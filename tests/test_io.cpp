@@ -0,0 +1,203 @@
+/**
+ * @file      test_io.cpp
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     mips_io.H against the results of synchronous I/O.
+ *
+ * Drives mips_async_io as the syscall emulation does and checks what
+ * the guest would see: a failed write-behind or console flush reported
+ * by the next write or close on that fd, read-ahead data and offsets,
+ * a forked child writing to the same file, and queued writes drained at
+ * exit.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+#include "mips_io.H"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond)) {                              \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);             \
+      fprintf(stderr, "\n");                    \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+static int core;                    // Key of the only core
+static std::string dir;
+
+static const unsigned char* bytes(const char* s)
+{
+  return (const unsigned char*) s;
+}
+
+static int create(const char* name)
+{
+  return open((dir + "/" + name).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+static off_t file_size(int fd)
+{
+  struct stat st;
+  return fstat(fd, &st) < 0 ? -1 : st.st_size;
+}
+
+//! Errors of background writes, with files limited to 1000 bytes.
+static void write_errors(mips_async_io& io)
+{
+  std::vector<unsigned char> buf(4000, 'x');
+  signal(SIGXFSZ, SIG_IGN);
+  struct rlimit old;
+  getrlimit(RLIMIT_FSIZE, &old);
+  struct rlimit rl = { 1000, old.rlim_max };
+  setrlimit(RLIMIT_FSIZE, &rl);
+
+  // Kept across syncs (lseek, fstat) for the next write
+  int fd = create("f1");
+  CHECK(io.write(&core, fd, &buf[0], buf.size()) == (long) buf.size(), "queued write failed");
+  io.sync(fd);
+  io.sync(fd);
+  errno = 0;
+  CHECK(io.write(&core, fd, &buf[0], 10) == -1 && errno == EFBIG,
+        "write after a failed write-behind: errno %d", errno);
+  CHECK(io.close(fd) == 0, "error reported twice");
+  close(fd);
+
+  // Or taken by close
+  fd = create("f2");
+  io.write(&core, fd, &buf[0], buf.size());
+  io.sync(fd);
+  CHECK(io.close(fd) == EFBIG, "close after a failed write-behind");
+  close(fd);
+
+  setrlimit(RLIMIT_FSIZE, &old);
+}
+
+//! A console write that fails when flushed fails the next write.
+static void console_errors(mips_async_io& io)
+{
+  signal(SIGPIPE, SIG_IGN);
+  fflush(stdout);
+  int saved = dup(1);
+  int p[2];
+  CHECK(pipe(p) == 0, "pipe");
+  close(p[0]);
+  dup2(p[1], 1);
+  close(p[1]);
+
+  CHECK(io.write(&core, 1, bytes("lost\n"), 5) == 5, "buffered console write failed");
+  errno = 0;
+  CHECK(io.write(&core, 1, bytes("next"), 4) == -1 && errno == EPIPE,
+        "console write after a failed flush: errno %d", errno);
+  CHECK(io.write(&core, 1, bytes("more"), 4) == 4, "console error reported twice");
+  CHECK(io.close(1) == EPIPE, "close after a failed console flush");
+
+  dup2(saved, 1);
+  close(saved);
+}
+
+//! Reads in small pieces give the file, and leave the host offset where
+//! the guest is once synced.
+static void read_ahead(mips_async_io& io)
+{
+  std::vector<unsigned char> data(3 * IO_CHUNK_SIZE + 123);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = i * 7 + (i >> 11);
+  int fd = create("r");
+  CHECK(write(fd, &data[0], data.size()) == (ssize_t) data.size(), "cannot write test file");
+  close(fd);
+
+  fd = open((dir + "/r").c_str(), O_RDONLY);
+  std::vector<unsigned char> got;
+  unsigned char buf[1000];
+  for (long n; (n = io.read(&core, fd, buf, sizeof(buf))) > 0; ) {
+    got.insert(got.end(), buf, buf + n);
+    if (got.size() == 2 * IO_CHUNK_SIZE + 5000) {
+      io.sync(fd);
+      CHECK(lseek(fd, 0, SEEK_CUR) == (off_t) got.size(), "offset after sync %ld, guest at %zu",
+            (long) lseek(fd, 0, SEEK_CUR), got.size());
+    }
+  }
+  CHECK(got == data, "read-ahead gave %zu bytes of %zu, or different ones", got.size(),
+        data.size());
+  io.close(fd);
+  close(fd);
+}
+
+//! Parent and forked child both write the same file.
+static void fork_writes(mips_async_io& io)
+{
+  std::vector<unsigned char> buf(100, 'y');
+  int fd = create("f3");
+  io.write(&core, fd, &buf[0], 100);
+  pid_t pid = fork();
+  if (pid == 0) {
+    io.write(&core, fd, &buf[0], 50);
+    io.exit(&core);
+    _exit(0);
+  }
+  int status;
+  CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+        "child did not finish");
+  io.write(&core, fd, &buf[0], 25);
+  io.exit(&core);
+  CHECK(file_size(fd) == 175, "parent and child wrote %ld bytes, expected 175",
+        (long) file_size(fd));
+  io.close(fd);
+  close(fd);
+}
+
+//! More than IO_MAX_QUEUED bytes, all on disk once the core exits.
+static void drain_at_exit(mips_async_io& io)
+{
+  std::vector<unsigned char> buf(100000, 'z');
+  int fd = create("g");
+  for (int i = 0; i < 100; i++)
+    io.write(&core, fd, &buf[0], buf.size());
+  io.exit(&core);
+  CHECK(file_size(fd) == 100 * (off_t) buf.size(), "%ld bytes on disk at exit",
+        (long) file_size(fd));
+  io.close(fd);
+  close(fd);
+}
+
+int main()
+{
+  char tmp[] = "/tmp/test_io.XXXXXX";
+  CHECK(mkdtemp(tmp) != NULL, "mkdtemp");
+  dir = tmp;
+
+  mips_async_io& io = mips_async_io::instance();
+  write_errors(io);
+  console_errors(io);
+  read_ahead(io);
+  fork_writes(io);
+  drain_at_exit(io);
+  if (system(("rm -rf " + dir).c_str()) != 0)
+    fprintf(stderr, "test_io: cannot remove %s\n", dir.c_str());
+
+  if (failures) {
+    fprintf(stderr, "test_io: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("test_io: ok\n");
+  return 0;
+}
@@ -0,0 +1,273 @@
+/**
+ * @file      test_trace.cpp
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     Differential co-simulation harness: mips_trace.H and
+ *            tools/mips_tracediff.cpp.
+ *
+ * Runs one program on the reference (mips_isa.cpp built with DIFF_TRACE,
+ * tracing through $MIPS_TRACE) and on one batch lane (set_trace), in
+ * instr, block and hash modes, and compares the traces with
+ * mips_tracediff. The same run must match. A lane with a register
+ * flipped at a known instruction, or whose store merges a wrong byte,
+ * must be reported at the first record of the reference trace that
+ * shows it.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+#include "mips_asm.H"
+#include "mips_ref.H"
+#include "mips_batch.H"
+
+using namespace mips_parms;
+
+#define TEXT_BASE  0x1000
+#define DATA_BASE  0x10000
+#define MAX_INSTRS 100000
+#define FLIP_AT    30                   // Instruction whose state shows the flipped register
+#define SEED_ADDR  (DATA_BASE + 0x100)  // Byte the seeded swl merges, not writes
+
+// o32 register names
+enum { zero, at, v0, v1, a0, a1, a2, a3, t0, t1, t2, t3, t4, t5, t6, t7,
+       s0, s1, s2, s3, s4, s5, s6, s7, t8, t9, k0, k1, gp, sp, fp, ra };
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                        \
+  do {                                          \
+    if (!(cond)) {                              \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);             \
+      fprintf(stderr, "\n");                    \
+      failures++;                               \
+    }                                           \
+  } while (0)
+
+//! A loop with a data dependent branch and stores, a call with a stack
+//! frame, then the swl the store seed shows in and a last store before
+//! the syscall. $s6 is never written.
+static std::vector<uint32_t> program()
+{
+  std::vector<uint32_t> w;
+  w.push_back(asm_i(MIPS_LUI, s0, 0, DATA_BASE >> 16));
+  w.push_back(asm_i(MIPS_ADDIU, t0, zero, 0));
+  w.push_back(asm_i(MIPS_ADDIU, t1, zero, 10));
+  uint32_t loop = TEXT_BASE + 4 * w.size();
+  w.push_back(asm_shift(MIPS_SLL, t2, t0, 2));
+  w.push_back(asm_r(MIPS_ADDU, t3, s0, t2));
+  w.push_back(asm_r(MIPS_MULT, 0, t0, t1));
+  w.push_back(asm_r(MIPS_MFLO, t4, 0, 0));
+  w.push_back(asm_i(MIPS_SW, t4, t3, 0));
+  w.push_back(asm_i(MIPS_ANDI, t5, t0, 1));
+  uint32_t even = TEXT_BASE + 4 * (w.size() + 3);
+  w.push_back(asm_b(MIPS_BEQ, t5, zero, TEXT_BASE + 4 * w.size(), even));
+  w.push_back(0);
+  w.push_back(asm_i(MIPS_SB, t0, t3, 0x80));
+  w.push_back(asm_i(MIPS_ADDIU, t0, t0, 1));
+  w.push_back(asm_b(MIPS_BNE, t0, t1, TEXT_BASE + 4 * w.size(), loop));
+  w.push_back(0);
+  uint32_t func = TEXT_BASE + 4 * (w.size() + 7);
+  w.push_back(asm_j(MIPS_JAL, func));
+  w.push_back(0);
+  w.push_back(asm_i(MIPS_SWL, t4, s0, SEED_ADDR + 1 - DATA_BASE));
+  w.push_back(asm_i(MIPS_ADDIU, v0, zero, 1));
+  w.push_back(asm_i(MIPS_SW, v0, s0, 0x104));
+  w.push_back(asm_r(MIPS_SYSCALL, 0, 0, 0));
+  w.push_back(0);
+  w.push_back(asm_i(MIPS_ADDIU, sp, sp, -8));
+  w.push_back(asm_i(MIPS_SW, ra, sp, 4));
+  w.push_back(asm_i(MIPS_LW, ra, sp, 4));
+  w.push_back(asm_r(MIPS_JR, 0, ra, 0));
+  w.push_back(asm_i(MIPS_ADDIU, sp, sp, 8));
+  return w;
+}
+
+//! Records of a trace file, as written by mips_trace.
+struct trace_file {
+  struct rec {
+    uint32_t type;
+    uint64_t count;               //!< State and hash records
+    uint32_t addr;                //!< Write records
+  };
+  std::vector<rec> recs;
+
+  bool read(const char* file)
+  {
+    FILE* f = fopen(file, "rb");
+    if (!f)
+      return false;
+    mips_trace_header h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && h.version == TRACE_VERSION;
+    uint32_t type;
+    while (ok && fread(&type, sizeof(type), 1, f) == 1) {
+      union {
+        mips_trace_state state;
+        mips_trace_write write;
+        mips_trace_hash hash;
+      } r;
+      size_t size = type == TRACE_STATE ? sizeof(r.state) :
+                    type == TRACE_WRITE ? sizeof(r.write) : sizeof(r.hash);
+      ok = fread((char*) &r + sizeof(type), size - sizeof(type), 1, f) == 1;
+      rec x = { type, 0, 0 };
+      if (type == TRACE_STATE)
+        x.count = r.state.count;
+      else if (type == TRACE_WRITE)
+        x.addr = r.write.addr;
+      else
+        x.count = r.hash.count;
+      recs.push_back(x);
+    }
+    fclose(f);
+    return ok;
+  }
+
+  //! First record showing a register changed before instruction count.
+  long first_state_at(uint64_t count) const
+  {
+    for (size_t i = 0; i < recs.size(); i++)
+      if (recs[i].type != TRACE_WRITE && recs[i].count >= count)
+        return i;
+    return -1;
+  }
+
+  //! First record showing a wrong write to addr by instruction count.
+  long first_write(uint32_t addr, uint64_t count) const
+  {
+    for (size_t i = 0; i < recs.size(); i++)
+      if (recs[i].type == TRACE_WRITE ? recs[i].addr == addr : recs[i].count > count)
+        return i;
+    return -1;
+  }
+};
+
+//! Run mips_tracediff on two traces. Returns its exit status and the
+//! number of matching records before the divergence it reports.
+static int tracediff(const std::string& ref, const std::string& cand, long& matched)
+{
+  std::string cmd = "./mips_tracediff " + ref + " " + cand;
+  FILE* p = popen(cmd.c_str(), "r");
+  if (!p)
+    return -1;
+  char line[256];
+  matched = -1;
+  while (fgets(line, sizeof(line), p)) {
+    unsigned long long n;
+    if (sscanf(line, "first divergence after %llu matching records", &n) == 1)
+      matched = n;
+  }
+  int status = pclose(p);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+enum seed { SEED_NONE, SEED_REGISTER, SEED_STORE };
+
+//! Trace one lane of the batch engine, started from the registers init.
+static void run_lane(const std::vector<uint8_t>& text, const uint32_t* init, const char* mode,
+                     const std::string& file, seed s)
+{
+  mips_batch_image image;
+  image.load(TEXT_BASE, &text[0], text.size());
+  mips_batch batch(1, &image, TEXT_BASE, 0);
+  for (int r = 0; r < 32; r++)
+    batch.RB[r][0] = init[r];
+  if (s == SEED_STORE)
+    batch.lane_mem(0).write_byte(SEED_ADDR, 0x5A);
+
+  mips_trace trace;
+  CHECK(trace.open(file.c_str(), mode), "cannot open %s", file.c_str());
+  batch.set_trace(0, &trace);
+  if (s == SEED_REGISTER) {
+    batch.run(FLIP_AT);
+    batch.RB[s6][0] ^= 0x100;
+  }
+  batch.run(MAX_INSTRS);
+  CHECK(batch.status[0] == mips_batch::LANE_SYSCALL, "%s lane status %u", mode,
+        batch.status[0]);
+  batch.finish_trace(0);
+}
+
+int main()
+{
+  std::vector<uint32_t> words = program();
+  std::vector<uint8_t> text;
+  for (size_t i = 0; i < words.size(); i++)
+    for (int k = 3; k >= 0; k--)
+      text.push_back(words[i] >> (8 * k));
+
+  char dir[] = "/tmp/test_trace.XXXXXX";
+  CHECK(mkdtemp(dir) != NULL, "mkdtemp");
+  std::string base = std::string(dir) + "/ref";
+  setenv("MIPS_TRACE", base.c_str(), 1);
+
+  // Instruction count of the seeded swl, from the instr trace
+  uint64_t swl_count = 0;
+  static const char* const modes[] = { "instr", "block", "hash:20" };
+  std::vector<mips_isa*> cores;
+  for (unsigned m = 0; m < 3; m++) {
+    const char* mode = modes[m];
+
+    // The reference traces core n into $MIPS_TRACE.n, and keeps its
+    // trace as long as the core (keyed by &RB) lives
+    setenv("MIPS_TRACE_MODE", mode, 1);
+    mips_isa* p = new mips_isa;
+    cores.push_back(p);
+    for (size_t i = 0; i < text.size(); i++)
+      p->DATA_PORT->write_byte(TEXT_BASE + i, text[i]);
+    p->ac_pc = TEXT_BASE;
+    p->beh_begin();
+    uint32_t init[32];
+    for (int r = 0; r < 32; r++)
+      init[r] = p->RB[r];
+    CHECK(ref_run(*p, MAX_INSTRS), "%s reference did not reach the syscall", mode);
+    p->beh_end();
+    std::string ref = m == 0 ? base : base + "." + std::to_string(m);
+
+    trace_file rt;
+    CHECK(rt.read(ref.c_str()), "cannot read %s", ref.c_str());
+    if (m == 0)
+      for (size_t i = 1; i < rt.recs.size(); i++)
+        if (rt.recs[i].type == TRACE_WRITE && rt.recs[i].addr == (SEED_ADDR & ~3u))
+          swl_count = rt.recs[i - 1].count;
+    CHECK(swl_count > FLIP_AT, "seeded swl not found in the instr trace");
+
+    long matched;
+    std::string cand = std::string(dir) + "/cand." + std::to_string(m);
+    run_lane(text, init, mode, cand, SEED_NONE);
+    CHECK(tracediff(ref, cand, matched) == 0, "%s traces of the same run differ", mode);
+
+    run_lane(text, init, mode, cand, SEED_REGISTER);
+    long expect = rt.first_state_at(FLIP_AT);
+    CHECK(tracediff(ref, cand, matched) == 1 && matched == expect,
+          "%s register seed reported after %ld records, expected %ld", mode, matched, expect);
+
+    run_lane(text, init, mode, cand, SEED_STORE);
+    expect = rt.first_write(SEED_ADDR & ~3u, swl_count);
+    CHECK(tracediff(ref, cand, matched) == 1 && matched == expect,
+          "%s store seed reported after %ld records, expected %ld", mode, matched, expect);
+  }
+  for (size_t i = 0; i < cores.size(); i++)
+    delete cores[i];
+  if (system((std::string("rm -rf ") + dir).c_str()) != 0)
+    fprintf(stderr, "test_trace: cannot remove %s\n", dir);
+
+  if (failures) {
+    fprintf(stderr, "test_trace: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("test_trace: ok, instr, block and hash traces\n");
+  return 0;
+}
@@ -0,0 +1,215 @@
+/**
+ * @file      mips_mkimage.cpp
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     Convert an ELF or ArchC hexadecimal file to a program
+ *            image (see mips_image.H).
+ *
+ *   g++ -std=c++11 -O2 -o mips_mkimage mips_mkimage.cpp
+ *   mips_mkimage [-e entry] [-s] <program.elf | program.hex> <program.mimg>
+ *
+ * -e overrides the entry point (for hex files it defaults to the lowest
+ * address), -s leaves the symbol table out. Hexadecimal input holds
+ * one "address word word ..." record per line, words are 32-bit.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../mips_elf.H"
+#include "../mips_image.H"
+
+struct out_segment {
+  uint32_t vaddr;
+  uint32_t memsz;
+  std::vector<uint8_t> data;
+};
+
+static bool read_elf(const char* file, std::vector<out_segment>& segs,
+                     std::vector<mips_elf::symbol>& syms, uint32_t& entry)
+{
+  mips_elf elf;
+  if (!elf.open(file))
+    return false;
+
+  for (size_t i = 0; i < elf.segments.size(); i++) {
+    const mips_elf::segment& s = elf.segments[i];
+    out_segment o;
+    o.vaddr = s.vaddr;
+    o.memsz = s.memsz;
+    o.data.assign(s.data, s.data + s.filesz);
+    segs.push_back(o);
+  }
+  syms = elf.symbols;
+  entry = elf.entry;
+  return true;
+}
+
+//! ArchC hexadecimal text: contiguous words are merged into segments.
+static bool read_hex(const char* file, std::vector<out_segment>& segs, uint32_t& entry)
+{
+  FILE* f = fopen(file, "r");
+  if (!f) {
+    perror(file);
+    return false;
+  }
+
+  std::map<uint32_t, uint32_t> words;
+  char line[4096];
+  unsigned int n = 0;
+  while (fgets(line, sizeof(line), f)) {
+    n++;
+    char* tok = strtok(line, " \t\r\n");
+    if (!tok || tok[0] == '#')
+      continue;
+    char* end;
+    uint32_t addr = strtoul(tok, &end, 16);
+    if (*end && *end != ':') {
+      fprintf(stderr, "%s:%u: bad address '%s'\n", file, n, tok);
+      fclose(f);
+      return false;
+    }
+    while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+      words[addr] = strtoul(tok, &end, 16);
+      if (*end) {
+        fprintf(stderr, "%s:%u: bad word '%s'\n", file, n, tok);
+        fclose(f);
+        return false;
+      }
+      addr += 4;
+    }
+  }
+  fclose(f);
+
+  if (words.empty()) {
+    fprintf(stderr, "%s: no data\n", file);
+    return false;
+  }
+  entry = words.begin()->first;
+
+  for (std::map<uint32_t, uint32_t>::iterator it = words.begin(); it != words.end(); ++it) {
+    if (segs.empty() || segs.back().vaddr + segs.back().memsz != it->first) {
+      out_segment o;
+      o.vaddr = it->first;
+      o.memsz = 0;
+      segs.push_back(o);
+    }
+    out_segment& o = segs.back();
+    uint32_t w = it->second;
+    uint8_t be[4] = { (uint8_t) (w >> 24), (uint8_t) (w >> 16), (uint8_t) (w >> 8), (uint8_t) w };
+    o.data.insert(o.data.end(), be, be + 4);
+    o.memsz += 4;
+  }
+  return true;
+}
+
+static void put(std::vector<uint8_t>& buf, uint32_t v)
+{
+  uint8_t be[4] = { (uint8_t) (v >> 24), (uint8_t) (v >> 16), (uint8_t) (v >> 8), (uint8_t) v };
+  buf.insert(buf.end(), be, be + 4);
+}
+
+int main(int argc, char** argv)
+{
+  const char* usage = "usage: %s [-e entry] [-s] <program.elf | program.hex> <program.mimg>\n";
+  bool strip = false, set_entry = false;
+  uint32_t entry = 0, forced_entry = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "e:s")) != -1) {
+    switch (opt) {
+    case 'e': set_entry = true; forced_entry = strtoul(optarg, NULL, 0); break;
+    case 's': strip = true; break;
+    default: fprintf(stderr, usage, argv[0]); return EXIT_FAILURE;
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, usage, argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char* in = argv[optind];
+  const char* out = argv[optind + 1];
+
+  std::vector<out_segment> segs;
+  std::vector<mips_elf::symbol> syms;
+  char magic[4] = { 0 };
+  FILE* f = fopen(in, "rb");
+  if (!f) {
+    perror(in);
+    return EXIT_FAILURE;
+  }
+  size_t got = fread(magic, 1, 4, f);
+  fclose(f);
+
+  bool ok = (got == 4 && !memcmp(magic, "\177ELF", 4)) ? read_elf(in, segs, syms, entry)
+                                                       : read_hex(in, segs, entry);
+  if (!ok)
+    return EXIT_FAILURE;
+  if (set_entry)
+    entry = forced_entry;
+  if (strip)
+    syms.clear();
+
+  // Tables: segments, symbols, string table, then the 4 byte aligned contents
+  std::vector<uint8_t> strtab(1, 0), body;
+  for (size_t i = 0; i < syms.size(); i++) {
+    put(body, syms[i].value);
+    put(body, syms[i].size);
+    put(body, strtab.size());
+    strtab.insert(strtab.end(), syms[i].name.begin(), syms[i].name.end());
+    strtab.push_back(0);
+  }
+  while (strtab.size() % 4)
+    strtab.push_back(0);
+
+  uint32_t offset = sizeof(mimg_header) + segs.size() * sizeof(mimg_segment) +
+                    body.size() + strtab.size();
+  std::vector<uint8_t> table;
+  for (size_t i = 0; i < segs.size(); i++) {
+    put(table, segs[i].vaddr);
+    put(table, segs[i].data.size());
+    put(table, segs[i].memsz);
+    put(table, offset);
+    offset += (segs[i].data.size() + 3) & ~3;
+  }
+  table.insert(table.end(), body.begin(), body.end());
+  table.insert(table.end(), strtab.begin(), strtab.end());
+  for (size_t i = 0; i < segs.size(); i++) {
+    table.insert(table.end(), segs[i].data.begin(), segs[i].data.end());
+    while (table.size() % 4)
+      table.push_back(0);
+  }
+
+  mimg_header h;
+  memcpy(h.magic, MIMG_MAGIC, 4);
+  h.version = mimg_be32(MIMG_VERSION);
+  h.entry = mimg_be32(entry);
+  h.num_segments = mimg_be32(segs.size());
+  h.num_symbols = mimg_be32(syms.size());
+  h.strtab_size = mimg_be32(strtab.size());
+  h.crc32 = mimg_be32(mimg_crc32(table.data(), table.size()));
+  h.reserved = 0;
+
+  f = fopen(out, "wb");
+  if (!f || fwrite(&h, sizeof(h), 1, f) != 1 ||
+      fwrite(table.data(), 1, table.size(), f) != table.size() || fclose(f) != 0) {
+    perror(out);
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: %zu segments, %zu symbols, entry %#x\n", out, segs.size(), syms.size(), entry);
+  return EXIT_SUCCESS;
+}
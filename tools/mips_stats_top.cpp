@@ -0,0 +1,168 @@
+/**
+ * @file      mips_stats_top.cpp
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     Reader for the live statistics segment (see mips_stats.H).
+ *
+ * Prints, per core, the rates between two samples: simulated MIPS,
+ * loads/stores/syscalls per second, cache hit ratio, and the energy in
+ * joules (PowerSC power times execution time) with the joules added per
+ * second of wall time. The simulation is never paused.
+ *
+ *   g++ -std=c++11 -O2 -I.. -o mips_stats_top mips_stats_top.cpp -lrt
+ *   mips_stats_top [-i seconds] [-n samples] [-o] <shm name | simulator pid>
+ *
+ * -o also prints the five most executed instructions of each core.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "../mips_stats.H"
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//! Plain copy of the counters of one core.
+struct sample {
+  uint64_t instructions, loads, stores, syscalls, cache_hits, cache_misses;
+  uint64_t profile;
+  double energy;
+  uint64_t opcode[MIPS_NUM_INSTR + 1];
+};
+
+static void take(const mips_stats_core& c, sample& s)
+{
+  s.instructions = c.instructions.load(std::memory_order_relaxed);
+  s.loads = c.loads.load(std::memory_order_relaxed);
+  s.stores = c.stores.load(std::memory_order_relaxed);
+  s.syscalls = c.syscalls.load(std::memory_order_relaxed);
+  s.cache_hits = c.cache_hits.load(std::memory_order_relaxed);
+  s.cache_misses = c.cache_misses.load(std::memory_order_relaxed);
+  s.profile = c.power_profile.load(std::memory_order_relaxed);
+  s.energy = mips_stats_shm::get_double(c.energy);
+  for (int i = 0; i <= MIPS_NUM_INSTR; i++)
+    s.opcode[i] = c.opcode[i].load(std::memory_order_relaxed);
+}
+
+static void print_opcodes(const sample& s)
+{
+  bool used[MIPS_NUM_INSTR + 1] = { false };
+
+  printf("      top:");
+  for (int k = 0; k < 5; k++) {
+    int best = -1;
+    for (int i = 0; i <= MIPS_NUM_INSTR; i++)
+      if (!used[i] && s.opcode[i] && (best < 0 || s.opcode[i] > s.opcode[best]))
+        best = i;
+    if (best < 0)
+      break;
+    used[best] = true;
+    printf(" %s=%llu", mips_instr_name[best], (unsigned long long) s.opcode[best]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+  double interval = 1.0;
+  long samples = -1;
+  bool opcodes = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:n:o")) != -1) {
+    switch (opt) {
+    case 'i': interval = atof(optarg); break;
+    case 'n': samples = atol(optarg); break;
+    case 'o': opcodes = true; break;
+    default:
+      fprintf(stderr, "usage: %s [-i seconds] [-n samples] [-o] <shm name | pid>\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-i seconds] [-n samples] [-o] <shm name | pid>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  char name[64];
+  if (isdigit((unsigned char) argv[optind][0]))
+    snprintf(name, sizeof(name), "/mips_stats_%s", argv[optind]);
+  else
+    snprintf(name, sizeof(name), "%s", argv[optind]);
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    perror(name);
+    return EXIT_FAILURE;
+  }
+  const mips_stats_segment* seg = (const mips_stats_segment*)
+    mmap(NULL, sizeof(mips_stats_segment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (seg == MAP_FAILED) {
+    perror("mmap");
+    return EXIT_FAILURE;
+  }
+  if (seg->magic != STATS_MAGIC || seg->version != STATS_VERSION) {
+    fprintf(stderr, "%s: not a version %d statistics segment\n", name, STATS_VERSION);
+    return EXIT_FAILURE;
+  }
+
+  static sample last[STATS_MAX_CORES], cur[STATS_MAX_CORES];
+  double last_t = now();
+  for (int i = 0; i < STATS_MAX_CORES; i++)
+    take(seg->core[i], last[i]);
+
+  for (long n = 0; samples < 0 || n < samples; n++) {
+    usleep((useconds_t) (interval * 1e6));
+    double t = now(), dt = t - last_t;
+    uint32_t cores = seg->num_cores.load(std::memory_order_acquire);
+
+    printf("%4s %14s %9s %11s %11s %9s %7s %12s %10s %3s\n", "core", "instructions",
+           "MIPS", "loads/s", "stores/s", "sysc/s", "hit%", "energy J", "J/s", "pf");
+    for (uint32_t i = 0; i < cores; i++) {
+      take(seg->core[i], cur[i]);
+      const sample& a = last[i];
+      const sample& b = cur[i];
+      uint64_t accesses = (b.cache_hits - a.cache_hits) + (b.cache_misses - a.cache_misses);
+
+      printf("%4u %14llu %9.3f %11.0f %11.0f %9.0f ", i,
+             (unsigned long long) b.instructions,
+             (b.instructions - a.instructions) / dt / 1e6,
+             (b.loads - a.loads) / dt, (b.stores - a.stores) / dt,
+             (b.syscalls - a.syscalls) / dt);
+      if (accesses)
+        printf("%7.2f", 100.0 * (b.cache_hits - a.cache_hits) / accesses);
+      else
+        printf("%7s", "-");
+      printf(" %12.6g %10.4g %3llu\n", b.energy, (b.energy - a.energy) / dt,
+             (unsigned long long) b.profile);
+      if (opcodes)
+        print_opcodes(b);
+      last[i] = cur[i];
+    }
+    printf("\n");
+    fflush(stdout);
+    last_t = t;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,399 @@
+/**
+ * @file      mips_tracediff.cpp
+ * @author    The ArchC Team
+ *            http://www.archc.org/
+ *
+ *            Computer Systems Laboratory (LSC)
+ *            IC-UNICAMP
+ *            http://www.lsc.ic.unicamp.br/
+ *
+ * @brief     Compare two execution traces (see mips_trace.H) and report
+ *            the first divergence.
+ *
+ *   g++ -std=c++11 -O2 -o mips_tracediff mips_tracediff.cpp
+ *   mips_tracediff [-c context] <reference.trace> <candidate.trace>
+ *   mips_tracediff [-c context] [-n steps] -b <program.mimg> <reference.trace>
+ *
+ * The reference trace comes from the simulator built with DIFF_TRACE.
+ * Either trace may be a FIFO, so both runs can proceed side by side
+ * and stop being compared at the first difference.
+ *
+ * With -b the candidate is the batch engine (mips_batch.H), run here on
+ * one lane from the program image. It starts from the first state of
+ * the reference trace, with the same granularity, and stops at the first
+ * syscall or break: programs are compared up to their first system
+ * call, and the end of the candidate trace there is the end of the
+ * match. Its trace is kept in <reference.trace>.batch. The engine runs
+ * from the predecode table of the image (mips_predecode.H), so the
+ * cached table is checked as well. The image has no argv or environment
+ * (the registers pointing to them come from the reference), so programs
+ * that read them before their first system call diverge.
+ *
+ * Exit status: 0 when the traces match (with -b, up to the first system
+ * call), 1 on a divergence, 2 on errors.
+ *
+ * @attention Copyright (C) 2002-2006 --- The ArchC Team
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+
+#include "../mips_trace.H"
+#include "../mips_decode.H"
+#include "../mips_image.H"
+#include "../mips_batch.H"
+
+static const char* const reg_name[32] = {
+  "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+  "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+  "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+  "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+//! One record of any type.
+struct record {
+  uint32_t type;
+  union {
+    mips_trace_state state;
+    mips_trace_write write;
+    mips_trace_hash hash;
+  };
+};
+
+class trace_reader {
+public:
+  mips_trace_header header;
+  const char* name;
+  unsigned long long records;
+
+  trace_reader() : name(NULL), records(0), f(NULL) {}
+  ~trace_reader() { if (f) fclose(f); }
+
+  bool open(const char* file)
+  {
+    name = file;
+    f = fopen(file, "rb");
+    if (!f) {
+      perror(file);
+      return false;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, 4) || header.version != TRACE_VERSION) {
+      fprintf(stderr, "%s: not a version %d trace\n", file, TRACE_VERSION);
+      return false;
+    }
+    return true;
+  }
+
+  //! Next record, false at the end of the file.
+  bool next(record& r)
+  {
+    uint32_t type;
+    if (fread(&type, sizeof(type), 1, f) != 1)
+      return false;
+    size_t size;
+    switch (type) {
+    case TRACE_STATE:      size = sizeof(r.state); break;
+    case TRACE_WRITE:      size = sizeof(r.write); break;
+    case TRACE_HASH_POINT:
+    case TRACE_END:        size = sizeof(r.hash); break;
+    default:
+      fprintf(stderr, "%s: bad record type %u after %llu records\n", name, type, records);
+      exit(2);
+    }
+    r.type = type;
+    memcpy(&r.state, &type, sizeof(type));
+    if (fread((char*) &r.state + sizeof(type), size - sizeof(type), 1, f) != 1)
+      return false;     // truncated, as if the writer stopped here
+    records++;
+    return true;
+  }
+
+private:
+  FILE* f;
+};
+
+static std::string describe(const record& r)
+{
+  char buf[160];
+  switch (r.type) {
+  case TRACE_STATE:
+    snprintf(buf, sizeof(buf), "#%-10llu pc %08x  %08x  %s",
+             (unsigned long long) r.state.count, r.state.pc, r.state.instr,
+             mips_instr_name[mips_decode(r.state.instr).id]);
+    break;
+  case TRACE_WRITE:
+    snprintf(buf, sizeof(buf), "            write [%08x] %u bytes %08x",
+             r.write.addr, r.write.size, r.write.value);
+    break;
+  default:
+    snprintf(buf, sizeof(buf), "#%-10llu pc %08x  %s state %016llx writes %llu (%016llx)",
+             (unsigned long long) r.hash.count, r.hash.pc,
+             r.type == TRACE_END ? "end " : "hash",
+             (unsigned long long) r.hash.state_hash, (unsigned long long) r.hash.writes,
+             (unsigned long long) r.hash.write_hash);
+  }
+  return buf;
+}
+
+static const char* type_name(uint32_t type)
+{
+  switch (type) {
+  case TRACE_STATE:      return "an instruction";
+  case TRACE_WRITE:      return "a memory write";
+  case TRACE_HASH_POINT: return "a hash point";
+  default:               return "the end of the run";
+  }
+}
+
+//! True if two records of the same type are equal; with print, show
+//! what differs.
+static bool compare(const record& a, const record& b, bool print)
+{
+  bool same = true;
+  switch (a.type) {
+  case TRACE_STATE: {
+    const mips_trace_state &x = a.state, &y = b.state;
+    if (x.count != y.count || x.pc != y.pc) {
+      if (print)
+        printf("  next instruction: reference #%llu at %08x, candidate #%llu at %08x\n",
+               (unsigned long long) x.count, x.pc, (unsigned long long) y.count, y.pc);
+      same = false;
+    }
+    for (int i = 0; i < 32; i++)
+      if (x.regs[i] != y.regs[i]) {
+        if (print)
+          printf("  $%-4s reference %08x candidate %08x\n", reg_name[i], x.regs[i], y.regs[i]);
+        same = false;
+      }
+    if (x.hi != y.hi) {
+      if (print)
+        printf("  hi    reference %08x candidate %08x\n", x.hi, y.hi);
+      same = false;
+    }
+    if (x.lo != y.lo) {
+      if (print)
+        printf("  lo    reference %08x candidate %08x\n", x.lo, y.lo);
+      same = false;
+    }
+    if (same && x.instr != y.instr) {
+      if (print)
+        printf("  instruction word at %08x: reference %08x candidate %08x\n",
+               x.pc, x.instr, y.instr);
+      same = false;
+    }
+    break;
+  }
+  case TRACE_WRITE:
+    if (memcmp(&a.write, &b.write, sizeof(a.write))) {
+      if (print)
+        printf("  write: reference [%08x] %u bytes %08x, candidate [%08x] %u bytes %08x\n",
+               a.write.addr, a.write.size, a.write.value,
+               b.write.addr, b.write.size, b.write.value);
+      same = false;
+    }
+    break;
+  default: {
+    const mips_trace_hash &x = a.hash, &y = b.hash;
+    if (x.count != y.count || x.pc != y.pc) {
+      if (print)
+        printf("  position: reference #%llu at %08x, candidate #%llu at %08x\n",
+               (unsigned long long) x.count, x.pc, (unsigned long long) y.count, y.pc);
+      same = false;
+    }
+    if (x.state_hash != y.state_hash) {
+      if (print)
+        printf("  registers differ (state hash %016llx vs %016llx)\n",
+               (unsigned long long) x.state_hash, (unsigned long long) y.state_hash);
+      same = false;
+    }
+    if (x.writes != y.writes || x.write_hash != y.write_hash) {
+      if (print)
+        printf("  memory writes differ (%llu writes, hash %016llx vs %llu, %016llx)\n",
+               (unsigned long long) x.writes, (unsigned long long) x.write_hash,
+               (unsigned long long) y.writes, (unsigned long long) y.write_hash);
+      same = false;
+    }
+  }
+  }
+  return same;
+}
+
+//! Run the batch engine on one lane, started from the reference state
+//! first, writing the candidate trace to file.
+static bool run_batch(const char* image_file, const record& first,
+                      const mips_trace_header& h, const char* file,
+                      unsigned long long steps, mips_batch::lane_status& status)
+{
+  mips_image image;
+  if (!image.open(image_file))
+    return false;
+  if (image.entry != first.state.pc)
+    fprintf(stderr, "mips_tracediff: reference starts at %08x, image entry is %08x\n",
+            first.state.pc, image.entry);
+
+  mips_batch_image mem;
+  for (uint32_t i = 0; i < image.num_segments; i++)
+    mem.load(image.segment(i).vaddr, image.segment_data(i), image.segment(i).filesz);
+
+  mips_predecode table;
+  bool predecoded = table.load(image, image_file);
+  if (!predecoded)
+    fprintf(stderr, "mips_tracediff: no predecode table, decoding every fetch\n");
+
+  mips_batch batch(1, &mem, first.state.pc, first.state.regs[29]);
+  if (predecoded)
+    batch.set_predecode(&table);
+  for (int i = 0; i < 32; i++)
+    batch.RB[i][0] = first.state.regs[i];
+  batch.hi[0] = first.state.hi;
+  batch.lo[0] = first.state.lo;
+
+  char spec[64];
+  if (h.mode == TRACE_HASH)
+    snprintf(spec, sizeof(spec), "hash:%llu@%llu", (unsigned long long) h.period,
+             (unsigned long long) h.start);
+  else
+    snprintf(spec, sizeof(spec), "%s@%llu", mips_trace_mode_name(h.mode),
+             (unsigned long long) h.start);
+  mips_trace trace;
+  if (!trace.open(file, spec))
+    return false;
+  batch.set_trace(0, &trace);
+
+  batch.run(steps);
+  status = (mips_batch::lane_status) batch.status[0];
+  if (batch.status[0] == mips_batch::LANE_RUNNING)
+    fprintf(stderr, "mips_tracediff: candidate still running after %llu steps\n", steps);
+  else if (batch.status[0] == mips_batch::LANE_FAULT)
+    fprintf(stderr, "mips_tracediff: candidate stopped on an exception at %08x\n",
+            batch.pc[0] - 4);
+  batch.finish_trace(0);
+  return true;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: mips_tracediff [-c context] <reference.trace> <candidate.trace>\n"
+                  "       mips_tracediff [-c context] [-n steps] -b <program.mimg> <reference.trace>\n");
+  exit(2);
+}
+
+int main(int argc, char** argv)
+{
+  unsigned context = 8;
+  unsigned long long steps = 1000000000ULL;
+  const char* image = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:n:b:")) != -1)
+    switch (opt) {
+    case 'c': context = atoi(optarg); break;
+    case 'n': steps = strtoull(optarg, NULL, 0); break;
+    case 'b': image = optarg; break;
+    default: usage();
+    }
+  if (argc - optind != (image ? 1 : 2))
+    usage();
+
+  trace_reader ref, cand;
+  if (!ref.open(argv[optind]))
+    return 2;
+
+  record a, b;
+  bool have_a = ref.next(a);
+  std::string batch_file;
+  mips_batch::lane_status status = mips_batch::LANE_RUNNING;
+  if (image) {
+    // The image holds the initial memory, so the run must start there too
+    if (!have_a || a.type != TRACE_STATE || ref.header.start != 0) {
+      fprintf(stderr, "%s: -b needs a trace from the first instruction\n", ref.name);
+      return 2;
+    }
+    batch_file = std::string(argv[optind]) + ".batch";
+    if (!run_batch(image, a, ref.header, batch_file.c_str(), steps, status))
+      return 2;
+    if (!cand.open(batch_file.c_str()))
+      return 2;
+  }
+  else if (!cand.open(argv[optind + 1]))
+    return 2;
+
+  const mips_trace_header &x = ref.header, &y = cand.header;
+  if (x.mode != y.mode || x.period != y.period || x.start != y.start) {
+    fprintf(stderr, "mips_tracediff: traces use different modes (%s:%llu@%llu and %s:%llu@%llu)\n",
+            mips_trace_mode_name(x.mode), (unsigned long long) x.period,
+            (unsigned long long) x.start, mips_trace_mode_name(y.mode),
+            (unsigned long long) y.period, (unsigned long long) y.start);
+    return 2;
+  }
+
+  std::deque<record> last;          //!< Matching records before the divergence
+  unsigned long long matched = 0, last_count = 0;
+  bool have_b;
+  for (;; have_a = ref.next(a)) {
+    have_b = cand.next(b);
+    // The batch engine ended at a system call. The reference records a
+    // block right after it, so a state or hash record at or past the end
+    // means everything before matched; a write here was made before the
+    // system call and the candidate is missing it
+    if (status == mips_batch::LANE_SYSCALL && have_b && b.type == TRACE_END &&
+        (!have_a || (a.type != TRACE_WRITE &&
+                     (a.type == TRACE_STATE ? a.state.count : a.hash.count) >= b.hash.count))) {
+      printf("traces match up to the first system call: %llu records, %llu instructions, "
+             "%llu writes\n", matched, (unsigned long long) b.hash.count,
+             (unsigned long long) b.hash.writes);
+      return 0;
+    }
+    if (!have_a && !have_b) {
+      if (!last.empty() && last.back().type == TRACE_END) {
+        printf("traces match: %llu records, %llu instructions, %llu writes\n", matched,
+               (unsigned long long) last.back().hash.count,
+               (unsigned long long) last.back().hash.writes);
+        return 0;
+      }
+      printf("traces match for %llu records, but end without an end record "
+             "(truncated runs?)\n", matched);
+      return 1;
+    }
+    if (have_a && have_b && a.type == b.type && compare(a, b, false)) {
+      matched++;
+      if (a.type == TRACE_STATE)
+        last_count = a.state.count;
+      else if (a.type != TRACE_WRITE)
+        last_count = a.hash.count;
+      last.push_back(a);
+      if (last.size() > context)
+        last.pop_front();
+      continue;
+    }
+    break;
+  }
+
+  printf("first divergence after %llu matching records, at or after instruction %llu:\n",
+         matched, last_count);
+  if (!have_a || !have_b)
+    printf("  the %s trace ends, the other continues with %s\n",
+           have_a ? "candidate" : "reference", type_name(have_a ? a.type : b.type));
+  else if (a.type != b.type)
+    printf("  reference has %s, candidate has %s\n", type_name(a.type), type_name(b.type));
+  else
+    compare(a, b, true);
+
+  if (!last.empty()) {
+    printf("\nlast matching records:\n");
+    for (size_t i = 0; i < last.size(); i++)
+      printf("  %s\n", describe(last[i]).c_str());
+  }
+  printf("\ndiverging records:\n");
+  printf("  reference %s\n", have_a ? describe(a).c_str() : "(end of trace)");
+  printf("  candidate %s\n", have_b ? describe(b).c_str() : "(end of trace)");
+  if (x.mode == TRACE_HASH)
+    printf("\nrerun both with MIPS_TRACE_MODE=instr@%llu to see the instruction\n",
+           last_count);
+  return 1;
+}